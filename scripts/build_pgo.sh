@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+
+# Builds the demos with clang profile-guided optimization, and with BOLT
+# on top when llvm-bolt and perf are installed, then compares their run
+# times with the plain release build.
+#
+# 1. temp/build-pgo-generate: instrumented build
+# 2. temp/pgo: profiles of the training runs, merged into merged.profdata
+# 3. temp/build-pgo: release build optimized with the merged profile
+# 4. temp/build-pgo/*.bolt: the same binaries, reordered by llvm-bolt
+
+set -e
+set -u
+set -x
+
+test -d src/
+test -d temp/
+
+CXX=${CXX:-clang++-14}
+PROFDATA=${PROFDATA:-llvm-profdata-14}
+BOLT=${BOLT:-llvm-bolt}
+PERF2BOLT=${PERF2BOLT:-perf2bolt}
+DEMOS="demo_coarse_grained demo_striped demo_refinable demo_adaptive"
+
+# The workload the profiles are trained on: the benchmark with every
+# key type
+train() {
+  for key_type in int uint64 short_string long_string large_struct; do
+    "$1" 8 4 100000 ${key_type}
+  done
+}
+
+# Prints the median time in ms of five runs of the benchmark
+measure() {
+  for run in 1 2 3 4 5; do
+    "$1" 8 4 100000 | awk '$2 == "ms" { print $1 }'
+  done | sort -n | sed -n 3p
+}
+
+cd temp
+
+mkdir -p build-release
+pushd build-release
+cmake -G "Unix Makefiles" ../.. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_COMPILER=${CXX}
+cmake --build . --config Release --parallel
+popd
+
+mkdir -p build-pgo-generate
+pushd build-pgo-generate
+cmake -G "Unix Makefiles" ../.. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_COMPILER=${CXX} -DUSE_PGO=generate
+cmake --build . --config Release --parallel
+popd
+
+rm -rf pgo
+mkdir -p pgo
+for demo in ${DEMOS}; do
+  LLVM_PROFILE_FILE="pgo/${demo}-%p.profraw" train build-pgo-generate/${demo}
+done
+${PROFDATA} merge -output=pgo/merged.profdata pgo/*.profraw
+
+mkdir -p build-pgo
+pushd build-pgo
+cmake -G "Unix Makefiles" ../.. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_COMPILER=${CXX} -DUSE_PGO=use -DPGO_PROFILE="$(pwd)/../pgo/merged.profdata" -DUSE_BOLT_RELOCS=ON
+cmake --build . --config Release --parallel
+popd
+
+use_bolt=0
+if command -v ${BOLT} && command -v ${PERF2BOLT} && command -v perf; then
+  use_bolt=1
+  for demo in ${DEMOS}; do
+    perf record -e cycles:u -j any,u -o pgo/${demo}.perf.data -- build-pgo/${demo} 8 4 100000
+    ${PERF2BOLT} -p pgo/${demo}.perf.data -o pgo/${demo}.fdata build-pgo/${demo}
+    ${BOLT} build-pgo/${demo} -o build-pgo/${demo}.bolt -data=pgo/${demo}.fdata -reorder-blocks=ext-tsp -reorder-functions=hfsort -split-functions -split-all-cold -icf=1
+  done
+fi
+
+set +x
+for demo in ${DEMOS}; do
+  echo "${demo}: release $(measure build-release/${demo}) ms, pgo $(measure build-pgo/${demo}) ms"
+  if [ ${use_bolt} -eq 1 ]; then
+    echo "${demo}: pgo+bolt $(measure build-pgo/${demo}.bolt) ms"
+  fi
+done
@@ -9,3 +9,51 @@ set -x
 ./temp/build-release/demo_coarse_grained 8 4 100000
 ./temp/build-release/demo_striped 8 4 100000
 ./temp/build-release/demo_refinable 8 4 100000
+
+for key_type in uint64 short_string long_string large_struct; do
+  ./temp/build-release/demo_coarse_grained 8 4 100000 ${key_type}
+  ./temp/build-release/demo_striped 8 4 100000 ${key_type}
+  ./temp/build-release/demo_refinable 8 4 100000 ${key_type}
+done
+
+# Oversubscription and preemption scenarios
+for demo in demo_coarse_grained demo_striped demo_refinable; do
+  ./temp/build-release/${demo} 8 4 100000 --oversubscribe=2
+  ./temp/build-release/${demo} 8 4 100000 --oversubscribe=4
+  ./temp/build-release/${demo} 8 4 100000 --cpus=2 --oversubscribe=4
+done
+# Only the striped set takes its locks through DeschedulingLock
+./temp/build-release/demo_striped 8 4 100000 --deschedule=0.0001 --deschedule_us=1000
+
+# Latency under load, sweeping the open-loop rate until saturation
+for demo in demo_coarse_grained demo_striped demo_refinable; do
+  ./temp/build-release/${demo} 8 4 100000 --open_loop_rate=100000 --sweep=10
+done
+
+# Memory per element, from 1K to 100M elements
+./temp/build-release/bench_memory 16 100000000
+./temp/build-release/bench_memory 16 10000000 long_string
+
+# A set spilling three quarters of its keys to disk
+for key_type in int uint64 large_struct; do
+  ./temp/build-release/demo_tiered 8 4 100000 ${key_type}
+done
+
+# Batched, pipelined requests to 4 partition server processes
+./temp/build-release/bench_partitioned 4 4 100000
+
+# Replicas following a primary, and how far they trail it
+./temp/build-release/bench_replicated 2 2 4 1000000
+
+# Checkpoints under ForEach against stripe-by-stripe snapshots
+./temp/build-release/bench_snapshot 4 10000000 ./temp
+
+# The same workload through the runtime registry
+for impl in coarse_grained coarse_grained_optimistic coarse_grained_sorted \
+    striped striped_tombstone striped_seeded refinable lock_free_buckets \
+    node_replicated; do
+  ./temp/build-release/hashset_bench 8 4 100000 --impl=${impl}
+done
+
+# The cost of seeded hashing, and what it saves on patterned keys
+./temp/build-release/bench_hash 100000
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_striped.h"
+#include "src/hash_set_striped_buffered.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Runs |body| on |num_threads| threads, and returns how long they took
+double TimeThreads(size_t num_threads,
+                   const std::function<void(size_t)> &body) {
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back(body, t);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void PrintRate(const std::string &name, size_t keys, double seconds) {
+  std::cout << name << ": "
+            << static_cast<uint64_t>(static_cast<double>(keys) / seconds)
+            << " adds/s" << std::endl;
+}
+
+} // namespace
+
+// Compares HashSetStriped::Add with HashSetStripedBuffered::Add on the
+// ingest pattern the latter is for: every thread adds keys that no other
+// thread has.
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " num_threads keys_per_thread flush_threshold" << std::endl;
+    return 1;
+  }
+  size_t num_threads = std::stoul(std::string(argv[1]));
+  size_t keys_per_thread = std::stoul(std::string(argv[2]));
+  size_t flush_threshold = std::stoul(std::string(argv[3]));
+  size_t keys = num_threads * keys_per_thread;
+
+  HashSetStriped<uint64_t> striped(16);
+  double seconds = TimeThreads(num_threads, [&](size_t t) {
+    for (uint64_t i = 0; i < keys_per_thread; i++) {
+      striped.Add(t * keys_per_thread + i);
+    }
+  });
+  PrintRate("HashSetStriped", keys, seconds);
+
+  HashSetStripedBuffered<uint64_t> buffered(16, flush_threshold);
+  seconds = TimeThreads(num_threads, [&](size_t t) {
+    for (uint64_t i = 0; i < keys_per_thread; i++) {
+      buffered.Add(t * keys_per_thread + i);
+    }
+    buffered.Flush();
+  });
+  PrintRate("HashSetStripedBuffered", keys, seconds);
+
+  if (striped.Size() != keys || buffered.Size() != keys) {
+    std::cerr << "Expected " << keys << " elements, found "
+              << striped.Size() << " and " << buffered.Size() << std::endl;
+    return 1;
+  }
+  return 0;
+}
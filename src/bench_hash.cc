@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/benchmark_keys.h"
+#include "src/hash_set_striped.h"
+#include "src/seeded_hash.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Hashes are summed into this, so that the compiler cannot drop them
+volatile size_t hash_sink = 0;
+
+double NanosSince(Clock::time_point start) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           start)
+          .count());
+}
+
+// Returns the average time of hashing each of |keys| with |hash|
+template <typename T, typename Hash>
+double NanosPerHash(const Hash &hash, const std::vector<T> &keys) {
+  constexpr size_t kRounds = 10;
+  size_t sum = 0;
+  auto start = Clock::now();
+  for (size_t round = 0; round < kRounds; round++) {
+    for (const T &key : keys) {
+      sum += hash(key);
+    }
+  }
+  double nanos = NanosSince(start);
+  hash_sink = sum;
+  return nanos / static_cast<double>(kRounds * keys.size());
+}
+
+template <typename T>
+void CompareHashes(const char *name, benchmark::KeyGenerator<T> make_key,
+                   size_t count) {
+  std::vector<T> keys;
+  keys.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    keys.push_back(make_key(i));
+  }
+  std::cout << std::setw(16) << name << std::setw(16)
+            << NanosPerHash<T>(std::hash<T>(), keys) << std::setw(16)
+            << NanosPerHash<T>(SeededHash<T>(), keys) << std::endl;
+}
+
+// Returns the time of adding and then looking up every one of |keys|
+template <template <typename...> class HashSetType>
+double MillisToFill(const std::vector<int> &keys) {
+  HashSetType<int> hash_set(16);
+  auto start = Clock::now();
+  for (int key : keys) {
+    hash_set.Add(key);
+  }
+  for (int key : keys) {
+    (void)hash_set.Contains(key);
+  }
+  return NanosSince(start) / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " num_keys" << std::endl;
+    return 1;
+  }
+  size_t count = std::stoul(std::string(argv[1]));
+
+  std::cout << "Hashing " << count << " keys" << std::endl;
+  std::cout << std::setw(16) << "key type" << std::setw(16) << "std::hash ns"
+            << std::setw(16) << "seeded ns" << std::endl;
+  CompareHashes<int>("int", benchmark::MakeIntKey, count);
+  CompareHashes<uint64_t>("uint64", benchmark::MakeUint64Key, count);
+  CompareHashes<std::string>("short_string", benchmark::MakeShortStringKey,
+                             count);
+  CompareHashes<std::string>("long_string", benchmark::MakeLongStringKey,
+                             count);
+  CompareHashes<benchmark::LargeKey>("large_struct", benchmark::MakeLargeKey,
+                                     count);
+
+  // Multiples of 4096 share a bucket under the identity hash until the
+  // table has more than 4096 buckets, which it only gets from 16K keys.
+  // Keep the keys within the range of int.
+  std::vector<int> patterned;
+  size_t patterned_count = std::min<size_t>(count, size_t{1} << 19);
+  for (size_t i = 0; i < patterned_count; i++) {
+    patterned.push_back(static_cast<int>(i << 12));
+  }
+  std::vector<int> sequential;
+  for (size_t i = 0; i < patterned_count; i++) {
+    sequential.push_back(static_cast<int>(i));
+  }
+  std::cout << "Adding and finding " << patterned_count << " int keys"
+            << std::endl;
+  std::cout << std::setw(16) << "keys" << std::setw(16) << "std::hash ms"
+            << std::setw(16) << "seeded ms" << std::endl;
+  std::cout << std::setw(16) << "sequential" << std::setw(16)
+            << MillisToFill<HashSetStriped>(sequential) << std::setw(16)
+            << MillisToFill<HashSetStripedSeeded>(sequential) << std::endl;
+  std::cout << std::setw(16) << "i << 12" << std::setw(16)
+            << MillisToFill<HashSetStriped>(patterned) << std::setw(16)
+            << MillisToFill<HashSetStripedSeeded>(patterned) << std::endl;
+  return 0;
+}
@@ -0,0 +1,249 @@
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <system_error>
+
+#include "src/benchmark.h"
+#include "src/hash_set_coarse_grained.h"
+#include "src/hash_set_frozen.h"
+#include "src/hash_set_refinable.h"
+#include "src/hash_set_sequential.h"
+#include "src/hash_set_striped.h"
+
+namespace {
+
+// Bytes currently handed out by operator new, as reported by the
+// allocator, so that its rounding up of small requests is included.
+std::atomic<size_t> allocated_bytes{0};
+
+void *CountedAllocate(size_t size) {
+  void *ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  allocated_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+  return ptr;
+}
+
+void *CountedAllocateAligned(size_t size, std::align_val_t alignment) {
+  auto align = static_cast<size_t>(alignment);
+  // aligned_alloc requires the size to be a multiple of the alignment
+  size_t rounded = (size + align - 1) / align * align;
+  void *ptr = std::aligned_alloc(align, rounded == 0 ? align : rounded);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  allocated_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+  return ptr;
+}
+
+void CountedFree(void *ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  allocated_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+  std::free(ptr);
+}
+
+} // namespace
+
+void *operator new(size_t size) { return CountedAllocate(size); }
+void *operator new[](size_t size) { return CountedAllocate(size); }
+void *operator new(size_t size, std::align_val_t alignment) {
+  return CountedAllocateAligned(size, alignment);
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return CountedAllocateAligned(size, alignment);
+}
+void operator delete(void *ptr) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr) noexcept { CountedFree(ptr); }
+void operator delete(void *ptr, size_t) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { CountedFree(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  CountedFree(ptr);
+}
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  CountedFree(ptr);
+}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  CountedFree(ptr);
+}
+
+namespace {
+
+// Returns the resident set size of this process in bytes
+size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void PrintRow(const char *name, size_t count, size_t allocated,
+              size_t resident) {
+  auto per_element = [count](size_t bytes) {
+    return static_cast<double>(bytes) / static_cast<double>(count);
+  };
+  std::cout << std::setw(16) << name << std::setw(12) << count << std::setw(16)
+            << allocated << std::fixed << std::setprecision(1)
+            << std::setw(12) << per_element(allocated) << std::setw(16)
+            << resident << std::setw(12) << per_element(resident) << std::endl;
+}
+
+// Waits for the child |pid| that measures |name|, and returns true if it
+// exited with status 0
+bool WaitForChild(pid_t pid, const char *name) {
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0) {
+    int error = errno;
+    if (error != EINTR) {
+      std::cerr << name << ": waitpid: "
+                << std::generic_category().message(error) << std::endl;
+      return false;
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::cerr << name << ": measurement failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Returns false, after saying why, if fork failed
+bool Forked(pid_t pid, const char *name) {
+  if (pid < 0) {
+    int error = errno;
+    std::cerr << name << ": fork: " << std::generic_category().message(error)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Inserts |count| keys into a fresh HashSetType and prints how much
+// memory it holds on to. Runs in a child process, so that neither the
+// allocator's caches nor the pages of earlier measurements are counted.
+// Returns false if the child could not be run or failed.
+template <template <typename...> class HashSetType, typename T>
+bool Measure(const char *name, benchmark::KeyGenerator<T> make_key,
+             size_t initial_capacity, size_t count) {
+  std::cout << std::flush;
+  pid_t pid = fork();
+  if (pid != 0) {
+    return Forked(pid, name) && WaitForChild(pid, name);
+  }
+
+  size_t allocated_before = allocated_bytes.load();
+  size_t resident_before = ResidentBytes();
+  auto *hash_set = new HashSetType<T>(initial_capacity);
+  for (size_t i = 0; i < count; i++) {
+    hash_set->Add(make_key(i));
+  }
+  PrintRow(name, count, allocated_bytes.load() - allocated_before,
+           ResidentBytes() - resident_before);
+  // Skip the destructor and the exit handlers of the parent's state
+  _exit(hash_set->Size() == count ? 0 : 1);
+}
+
+// Freezes a HashSetSequential of |count| keys and prints how much memory
+// the frozen set holds on to, in a child process like Measure. The pages
+// freed by the build stay resident, so only the allocated bytes count.
+template <typename T>
+bool MeasureFrozen(benchmark::KeyGenerator<T> make_key,
+                   size_t initial_capacity, size_t count) {
+  std::cout << std::flush;
+  pid_t pid = fork();
+  if (pid != 0) {
+    return Forked(pid, "frozen") && WaitForChild(pid, "frozen");
+  }
+
+  HashSetSequential<T> hash_set(initial_capacity);
+  for (size_t i = 0; i < count; i++) {
+    hash_set.Add(make_key(i));
+  }
+  size_t allocated_before = allocated_bytes.load();
+  auto *frozen = new HashSetFrozen<T>(hash_set);
+  PrintRow("frozen", count, allocated_bytes.load() - allocated_before, 0);
+  _exit(frozen->Size() == count ? 0 : 1);
+}
+
+// Returns false if any measurement failed
+template <typename T>
+bool MeasureAll(benchmark::KeyGenerator<T> make_key, size_t initial_capacity,
+                size_t max_count) {
+  std::cout << std::setw(16) << "implementation" << std::setw(12) << "elements"
+            << std::setw(16) << "alloc bytes" << std::setw(12) << "alloc/elem"
+            << std::setw(16) << "rss bytes" << std::setw(12) << "rss/elem"
+            << std::endl;
+  bool ok = true;
+  for (size_t count = 1000; count <= max_count; count *= 10) {
+    ok = Measure<HashSetSequential, T>("sequential", make_key,
+                                       initial_capacity, count) &&
+         ok;
+    ok = Measure<HashSetCoarseGrained, T>("coarse_grained", make_key,
+                                          initial_capacity, count) &&
+         ok;
+    ok = Measure<HashSetStriped, T>("striped", make_key, initial_capacity,
+                                    count) &&
+         ok;
+    ok = Measure<HashSetRefinable, T>("refinable", make_key,
+                                      initial_capacity, count) &&
+         ok;
+    ok = MeasureFrozen<T>(make_key, initial_capacity, count) && ok;
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 3 && argc != 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " initial_capacity max_elements [key_type]" << std::endl;
+    return 1;
+  }
+  size_t initial_capacity = std::stoul(std::string(argv[1]));
+  size_t max_count = std::stoul(std::string(argv[2]));
+  benchmark::KeyType key_type = benchmark::KeyType::kInt;
+  if (argc == 4 && !benchmark::ParseKeyType(argv[3], key_type)) {
+    std::cerr << argv[0] << ": unknown key type " << argv[3] << std::endl;
+    return 1;
+  }
+  std::cout << "Key type: " << benchmark::KeyTypeName(key_type) << std::endl;
+
+  bool ok = false;
+  switch (key_type) {
+  case benchmark::KeyType::kInt:
+    ok = MeasureAll<int>(benchmark::MakeIntKey, initial_capacity, max_count);
+    break;
+  case benchmark::KeyType::kUint64:
+    ok = MeasureAll<uint64_t>(benchmark::MakeUint64Key, initial_capacity,
+                              max_count);
+    break;
+  case benchmark::KeyType::kShortString:
+    ok = MeasureAll<std::string>(benchmark::MakeShortStringKey,
+                                 initial_capacity, max_count);
+    break;
+  case benchmark::KeyType::kLongString:
+    ok = MeasureAll<std::string>(benchmark::MakeLongStringKey,
+                                 initial_capacity, max_count);
+    break;
+  case benchmark::KeyType::kLargeStruct:
+    ok = MeasureAll<benchmark::LargeKey>(benchmark::MakeLargeKey,
+                                         initial_capacity, max_count);
+    break;
+  }
+  return ok ? 0 : 1;
+}
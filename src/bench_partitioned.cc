@@ -0,0 +1,157 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/partition.h"
+#include "src/partitioned_hash_set.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Requests per call, from one round trip per element to full batches
+constexpr size_t kBatchSizes[] = {1, 16, 256};
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Applies an operation to keys [first, first + count) in calls of
+// |batch_size| keys, and returns the number of true results
+size_t RunKeys(PartitionedHashSet<uint64_t> &hash_set, bool add,
+               uint64_t first, size_t count, size_t batch_size) {
+  size_t hits = 0;
+  std::vector<uint64_t> batch;
+  for (size_t i = 0; i < count; i += batch_size) {
+    size_t end = std::min(count, i + batch_size);
+    if (batch_size == 1) {
+      bool hit = add ? hash_set.Add(first + i) : hash_set.Contains(first + i);
+      hits += hit ? 1 : 0;
+      continue;
+    }
+    batch.clear();
+    for (size_t k = i; k < end; k++) {
+      batch.push_back(first + k);
+    }
+    if (add) {
+      hits += hash_set.AddBatch(batch);
+    } else {
+      std::vector<bool> found = hash_set.ContainsBatch(batch);
+      hits += static_cast<size_t>(
+          std::count(found.begin(), found.end(), true));
+    }
+  }
+  return hits;
+}
+
+// Runs |num_threads| threads over disjoint key ranges starting at |first|,
+// and returns the operations per second
+double MeasureOpsPerSecond(PartitionedHashSet<uint64_t> &hash_set, bool add,
+                           uint64_t first, size_t num_threads,
+                           size_t keys_per_thread, size_t batch_size,
+                           size_t &hits) {
+  std::vector<std::thread> threads;
+  std::vector<size_t> thread_hits(num_threads, 0);
+  auto start = Clock::now();
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t]() {
+      thread_hits[t] = RunKeys(hash_set, add, first + t * keys_per_thread,
+                               keys_per_thread, batch_size);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double seconds = SecondsSince(start);
+  hits = 0;
+  for (size_t thread_hit : thread_hits) {
+    hits += thread_hit;
+  }
+  return static_cast<double>(num_threads * keys_per_thread) / seconds;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " num_partitions num_threads keys_per_thread" << std::endl;
+    return 1;
+  }
+  size_t num_partitions = std::stoul(std::string(argv[1]));
+  size_t num_threads = std::stoul(std::string(argv[2]));
+  size_t keys_per_thread = std::stoul(std::string(argv[3]));
+  if (num_partitions == 0 || num_threads == 0) {
+    std::cerr << argv[0] << ": need at least one partition and thread"
+              << std::endl;
+    return 1;
+  }
+
+  // Servers are forked before any thread starts
+  std::vector<std::string> paths;
+  std::vector<pid_t> pids;
+  for (size_t p = 0; p < num_partitions; p++) {
+    paths.push_back("/tmp/hashsets_partition_" + std::to_string(getpid()) +
+                    "_" + std::to_string(p) + ".sock");
+    pids.push_back(partition::SpawnServer(paths.back(), 1024));
+    if (pids.back() < 0) {
+      std::cerr << argv[0] << ": could not start a server on " << paths.back()
+                << std::endl;
+      pids.pop_back();
+      for (size_t i = 0; i < pids.size(); i++) {
+        partition::StopServer(pids[i], paths[i]);
+      }
+      return 1;
+    }
+  }
+
+  std::cout << num_partitions << " partitions, " << num_threads
+            << " threads, " << keys_per_thread << " keys per thread"
+            << std::endl;
+  std::cout << std::setw(12) << "batch" << std::setw(16) << "add ops/s"
+            << std::setw(16) << "contains ops/s" << std::setw(12) << "size"
+            << std::endl;
+
+  bool ok = true;
+  uint64_t first = 0;
+  size_t expected_size = 0;
+  for (size_t batch_size : kBatchSizes) {
+    PartitionedHashSet<uint64_t> hash_set(paths, batch_size);
+    size_t added = 0;
+    size_t found = 0;
+    double add_rate = MeasureOpsPerSecond(hash_set, true, first, num_threads,
+                                          keys_per_thread, batch_size, added);
+    double contains_rate =
+        MeasureOpsPerSecond(hash_set, false, first, num_threads,
+                            keys_per_thread, batch_size, found);
+    expected_size += num_threads * keys_per_thread;
+    size_t size = hash_set.Size();
+    std::cout << std::setw(12) << batch_size << std::setw(16)
+              << static_cast<uint64_t>(add_rate) << std::setw(16)
+              << static_cast<uint64_t>(contains_rate) << std::setw(12)
+              << size << std::endl;
+
+    size_t keys = num_threads * keys_per_thread;
+    if (added != keys || found != keys || size != expected_size ||
+        hash_set.Errors() != 0) {
+      std::cerr << "Expected " << keys << " adds and lookups and size "
+                << expected_size << ", got " << added << ", " << found
+                << " and " << size << " with " << hash_set.Errors()
+                << " errors" << std::endl;
+      ok = false;
+    }
+    first += keys;
+  }
+
+  for (size_t p = 0; p < num_partitions; p++) {
+    partition::StopServer(pids[p], paths[p]);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/benchmark.h"
+#include "src/hash_set_factory.h"
+#include "src/latency_histogram.h"
+#include "src/trace.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ReplayOptions {
+  std::string implementation;
+  std::string trace_path;
+  size_t initial_capacity = 0;
+  size_t num_threads = 0; // 0 replays each recorded thread on its own thread
+  double speed = 0.0;     // 0 replays as fast as possible
+};
+
+void PrintUsage(const char *name) {
+  std::cerr << "Usage: " << name
+            << " implementation trace_file initial_capacity [flags]"
+            << std::endl;
+  std::cerr << "  implementation is one of "
+            << HashSetRegistry<uint64_t>::Names() << std::endl;
+  std::cerr << "  --threads=N   replay recorded thread t on thread t % N"
+            << std::endl;
+  std::cerr << "  --speed=X     replay at X times the recorded speed, or as"
+            << " fast as possible if 0 (default)" << std::endl;
+}
+
+bool ParseReplayOptions(int argc, char **argv, ReplayOptions &options) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string name;
+    std::string value;
+    if (!benchmark::SplitFlag(arg, name, value)) {
+      positional.push_back(arg);
+    } else if (name == "threads") {
+      options.num_threads = std::stoul(value);
+    } else if (name == "speed") {
+      options.speed = std::stod(value);
+    } else {
+      std::cerr << argv[0] << ": unknown flag --" << name << std::endl;
+      return false;
+    }
+  }
+  if (positional.size() != 3 || options.speed < 0.0) {
+    return false;
+  }
+  options.implementation = positional[0];
+  options.trace_path = positional[1];
+  options.initial_capacity = std::stoul(positional[2]);
+  return true;
+}
+
+// Replays |records| in order. With a non-zero |speed|, each record is
+// issued at its recorded time scaled by 1 / |speed| and its latency is
+// measured from then, like the open-loop benchmark; otherwise records are
+// issued back to back and the latency is the service time.
+void ReplayThreadBody(HashSetBase<uint64_t> &hash_set,
+                      const std::vector<trace::Record> &records, double speed,
+                      uint64_t first_timestamp, Clock::time_point start,
+                      benchmark::LatencyHistogram &latencies,
+                      size_t &mismatches) {
+  mismatches = 0;
+  for (const trace::Record &record : records) {
+    Clock::time_point issued = Clock::now();
+    if (speed > 0.0) {
+      auto offset = static_cast<int64_t>(
+          static_cast<double>(record.timestamp_nanos - first_timestamp) /
+          speed);
+      issued = start + std::chrono::nanoseconds(offset);
+      while (Clock::now() < issued) {
+      }
+    }
+
+    bool result = false;
+    switch (record.operation) {
+    case trace::Operation::kAdd:
+      result = hash_set.Add(record.key);
+      break;
+    case trace::Operation::kRemove:
+      result = hash_set.Remove(record.key);
+      break;
+    case trace::Operation::kContains:
+      result = hash_set.Contains(record.key);
+      break;
+    }
+
+    latencies.Record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             issued)
+            .count()));
+    if (result != (record.result != 0)) {
+      mismatches++;
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  ReplayOptions options;
+  if (!ParseReplayOptions(argc, argv, options)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<trace::Record> records;
+  std::string error;
+  if (!trace::ReadTrace(options.trace_path, records, error)) {
+    std::cerr << argv[0] << ": " << error << std::endl;
+    return 1;
+  }
+  if (records.empty()) {
+    std::cerr << argv[0] << ": " << options.trace_path << " is empty"
+              << std::endl;
+    return 1;
+  }
+  // Records of different threads are interleaved arbitrarily in the file
+  std::stable_sort(records.begin(), records.end(),
+                   [](const trace::Record &lhs, const trace::Record &rhs) {
+                     return lhs.timestamp_nanos < rhs.timestamp_nanos;
+                   });
+
+  size_t num_threads = options.num_threads;
+  if (num_threads == 0) {
+    for (const trace::Record &record : records) {
+      num_threads = std::max(num_threads, size_t{record.thread_id} + 1);
+    }
+  }
+  auto hash_set = MakeHashSet<uint64_t>(options.implementation,
+                                        options.initial_capacity);
+  if (hash_set == nullptr) {
+    std::cerr << argv[0] << ": unknown implementation "
+              << options.implementation << std::endl;
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (!IsThreadSafeHashSet<uint64_t>(options.implementation) &&
+      num_threads != 1) {
+    std::cerr << argv[0] << ": " << options.implementation
+              << " requires --threads=1" << std::endl;
+    return 1;
+  }
+
+  // Map recorded thread t to replay thread t % num_threads, keeping the
+  // order of each recorded thread's operations.
+  std::vector<std::vector<trace::Record>> per_thread(num_threads);
+  for (const trace::Record &record : records) {
+    per_thread[record.thread_id % num_threads].push_back(record);
+  }
+
+  std::vector<benchmark::LatencyHistogram> latencies(num_threads);
+  std::vector<size_t> mismatches(num_threads, 0);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+
+  // Timed replays start a little later, so that every thread is running
+  // when the first records are due
+  auto start = Clock::now();
+  if (options.speed > 0.0) {
+    start += std::chrono::milliseconds(10);
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back(std::thread(
+        ReplayThreadBody, std::ref(*hash_set), std::cref(per_thread[i]),
+        options.speed, records.front().timestamp_nanos, start,
+        std::ref(latencies[i]), std::ref(mismatches[i])));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  benchmark::LatencyHistogram total_latencies;
+  size_t total_mismatches = 0;
+  for (size_t i = 0; i < num_threads; i++) {
+    total_latencies.Merge(latencies[i]);
+    total_mismatches += mismatches[i];
+  }
+
+  auto micros = [](uint64_t nanos) {
+    return static_cast<double>(nanos) / 1000.0;
+  };
+  std::cout << "Replayed " << records.size() << " operations on "
+            << num_threads << " threads against " << options.implementation
+            << std::endl;
+  std::cout << "  " << elapsed.count() * 1000.0 << " ms, "
+            << static_cast<double>(records.size()) / elapsed.count()
+            << " ops/s" << std::endl;
+  std::cout << "  latency p50 " << micros(total_latencies.Percentile(50))
+            << " us, p99 " << micros(total_latencies.Percentile(99))
+            << " us, max " << micros(total_latencies.Max()) << " us"
+            << std::endl;
+  // Results differ from the recording when the interleaving changes, or
+  // when the recorded set was not empty at the start of the trace.
+  std::cout << "  " << total_mismatches
+            << " results differ from the recording" << std::endl;
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_replicated.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// How long writers and readers run
+constexpr std::chrono::milliseconds kDuration(1000);
+
+// Lookup results are summed into this, so that the compiler cannot drop
+// them
+std::atomic<size_t> found_sink{0};
+
+// Adds and removes random keys of [0, num_keys) until |stop|, and returns
+// the number of operations
+size_t WriterBody(HashSetPrimary<uint64_t> &primary, size_t num_keys,
+                  uint64_t seed, const std::atomic<bool> &stop) {
+  std::mt19937_64 random(seed);
+  size_t ops = 0;
+  while (!stop.load(std::memory_order_relaxed)) {
+    uint64_t key = random() % num_keys;
+    if (random() % 2 == 0) {
+      primary.Add(key);
+    } else {
+      primary.Remove(key);
+    }
+    ops++;
+  }
+  return ops;
+}
+
+// Looks up random keys of [0, num_keys) in |replica| until |stop|, and
+// returns the number of lookups
+size_t ReaderBody(HashSetReplica<uint64_t> &replica, size_t num_keys,
+                  uint64_t seed, const std::atomic<bool> &stop) {
+  std::mt19937_64 random(seed);
+  size_t ops = 0;
+  size_t found = 0;
+  while (!stop.load(std::memory_order_relaxed)) {
+    if (replica.Contains(random() % num_keys)) {
+      found++;
+    }
+    ops++;
+  }
+  found_sink.fetch_add(found, std::memory_order_relaxed);
+  return ops;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " num_writers num_replicas readers_per_replica num_keys"
+              << std::endl;
+    return 1;
+  }
+  size_t num_writers = std::stoul(std::string(argv[1]));
+  size_t num_replicas = std::stoul(std::string(argv[2]));
+  size_t readers_per_replica = std::stoul(std::string(argv[3]));
+  size_t num_keys = std::stoul(std::string(argv[4]));
+  if (num_keys == 0) {
+    std::cerr << argv[0] << ": need at least one key" << std::endl;
+    return 1;
+  }
+
+  HashSetPrimary<uint64_t> primary(num_keys / 4 + 1);
+  for (uint64_t key = 0; key < num_keys; key += 2) {
+    primary.Add(key);
+  }
+  std::vector<std::unique_ptr<HashSetReplica<uint64_t>>> replicas;
+  for (size_t r = 0; r < num_replicas; r++) {
+    replicas.push_back(std::make_unique<HashSetReplica<uint64_t>>(primary));
+  }
+
+  std::atomic<bool> stop{false};
+  std::vector<size_t> writes(num_writers, 0);
+  std::vector<size_t> reads(num_replicas * readers_per_replica, 0);
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < num_writers; w++) {
+    threads.emplace_back([&, w] {
+      writes[w] = WriterBody(primary, num_keys, w + 1, stop);
+    });
+  }
+  for (size_t i = 0; i < reads.size(); i++) {
+    threads.emplace_back([&, i] {
+      reads[i] = ReaderBody(*replicas[i / readers_per_replica], num_keys,
+                            1000 + i, stop);
+    });
+  }
+
+  // Sample the lag of every replica while the threads run
+  uint64_t max_lag_deltas = 0;
+  uint64_t max_lag_nanos = 0;
+  auto start = Clock::now();
+  while (Clock::now() - start < kDuration) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (const auto &replica : replicas) {
+      auto lag = replica->CurrentLag();
+      max_lag_deltas = std::max(max_lag_deltas, lag.deltas);
+      max_lag_nanos = std::max(max_lag_nanos, lag.nanos);
+    }
+  }
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  size_t total_writes = 0;
+  for (size_t count : writes) {
+    total_writes += count;
+  }
+  size_t total_reads = 0;
+  for (size_t count : reads) {
+    total_reads += count;
+  }
+  std::cout << num_writers << " writers: "
+            << static_cast<uint64_t>(static_cast<double>(total_writes) /
+                                     seconds)
+            << " writes/s" << std::endl;
+  std::cout << num_replicas << " replicas, " << readers_per_replica
+            << " readers each: "
+            << static_cast<uint64_t>(static_cast<double>(total_reads) /
+                                     seconds)
+            << " reads/s" << std::endl;
+  std::cout << "Sampled lag: up to " << max_lag_deltas << " deltas, "
+            << max_lag_nanos / 1000 << " us" << std::endl;
+
+  // Once caught up, every replica must equal the primary
+  bool ok = true;
+  for (size_t r = 0; r < num_replicas; r++) {
+    HashSetReplica<uint64_t> &replica = *replicas[r];
+    replica.ApplyPending();
+    size_t missing = 0;
+    primary.ForEach([&](const uint64_t &key) {
+      if (!replica.Contains(key)) {
+        missing++;
+      }
+    });
+    std::cout << "Replica " << r << ": longest apply delay "
+              << replica.MaxDelayNanos() / 1000 << " us, size "
+              << replica.Size() << " of " << primary.Size() << std::endl;
+    if (missing != 0 || replica.Size() != primary.Size()) {
+      std::cerr << "Replica " << r << " diverged, missing " << missing
+                << " keys" << std::endl;
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_striped.h"
+#include "src/snapshot.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Set = HashSetStriped<uint64_t>;
+
+struct WriterResult {
+  size_t ops = 0;            // Operations completed
+  uint64_t max_op_nanos = 0; // The longest of them
+};
+
+// Adds and removes random keys of [num_keys, 2 * num_keys) until |stop|,
+// so that the keys of [0, num_keys) stay in the set
+WriterResult WriterBody(Set &set, size_t num_keys, uint64_t seed,
+                        const std::atomic<bool> &stop) {
+  std::mt19937_64 random(seed);
+  WriterResult result;
+  while (!stop.load(std::memory_order_relaxed)) {
+    uint64_t key = num_keys + random() % num_keys;
+    auto start = Clock::now();
+    if (random() % 2 == 0) {
+      set.Add(key);
+    } else {
+      set.Remove(key);
+    }
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start);
+    result.max_op_nanos =
+        std::max(result.max_op_nanos, static_cast<uint64_t>(nanos.count()));
+    result.ops++;
+  }
+  return result;
+}
+
+// Writes every element to |path| from within ForEach, which holds every
+// stripe lock until the last one is written
+bool StopTheWorldSnapshot(Set &set, const std::string &path) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = true;
+  set.ForEach([&](const uint64_t &key) {
+    ok = ok && std::fwrite(&key, sizeof(key), 1, file) == 1;
+  });
+  ok = std::fflush(file) == 0 && fdatasync(fileno(file)) == 0 && ok;
+  return std::fclose(file) == 0 && ok;
+}
+
+// Runs |checkpoint| while |num_writers| threads change |set|, and prints
+// how long it took and how much it held the writers up
+bool Measure(const std::string &name, Set &set, size_t num_writers,
+             size_t num_keys, const std::function<bool()> &checkpoint) {
+  std::atomic<bool> stop{false};
+  std::vector<WriterResult> results(num_writers);
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < num_writers; w++) {
+    threads.emplace_back([&, w] {
+      results[w] = WriterBody(set, num_keys, w + 1, stop);
+    });
+  }
+
+  auto start = Clock::now();
+  bool ok = checkpoint();
+  double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  size_t ops = 0;
+  uint64_t max_op_nanos = 0;
+  for (const WriterResult &result : results) {
+    ops += result.ops;
+    max_op_nanos = std::max(max_op_nanos, result.max_op_nanos);
+  }
+  std::cout << name << ": " << static_cast<uint64_t>(seconds * 1000)
+            << " ms, writers did "
+            << static_cast<uint64_t>(static_cast<double>(ops) / seconds)
+            << " ops/s, longest op " << max_op_nanos / 1000 << " us"
+            << (ok ? "" : " (failed)") << std::endl;
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " num_writers num_keys directory"
+              << std::endl;
+    return 1;
+  }
+  size_t num_writers = std::stoul(std::string(argv[1]));
+  size_t num_keys = std::stoul(std::string(argv[2]));
+  std::string directory(argv[3]);
+  if (num_keys == 0) {
+    std::cerr << argv[0] << ": need at least one key" << std::endl;
+    return 1;
+  }
+
+  Set set(num_keys / 4 + 1);
+  for (uint64_t key = 0; key < num_keys; key++) {
+    set.Add(key);
+  }
+
+  std::string path = directory + "/hashsets_snapshot";
+  bool ok = Measure("ForEach, all locks held", set, num_writers, num_keys,
+                    [&] { return StopTheWorldSnapshot(set, path); });
+
+  for (bool direct : {false, true}) {
+    snapshot::Options options;
+    options.direct = direct;
+    snapshot::Stats stats;
+    ok = Measure(direct ? "Stripe by stripe, O_DIRECT" : "Stripe by stripe",
+                 set, num_writers, num_keys,
+                 [&] {
+                   return snapshot::WriteSnapshot(set, path, options,
+                                                  &stats);
+                 }) &&
+         ok;
+    std::cout << "  " << stats.elements << " elements in " << stats.stripes
+              << " stripes, " << stats.bytes / 1024 << " KiB, longest stripe "
+              << stats.max_stripe_nanos / 1000 << " us, "
+              << (stats.io_uring ? "io_uring" : "pwrite")
+              << (stats.direct ? ", O_DIRECT" : "") << std::endl;
+  }
+
+  // The last snapshot must hold every key that was never removed, and
+  // nothing else
+  Set loaded(num_keys / 4 + 1);
+  std::string error;
+  if (!snapshot::LoadSnapshot(path, loaded, error)) {
+    std::cerr << error << std::endl;
+    ok = false;
+  }
+  size_t missing = 0;
+  for (uint64_t key = 0; key < num_keys; key++) {
+    if (!loaded.Contains(key)) {
+      missing++;
+    }
+  }
+  size_t unknown = 0;
+  loaded.ForEach([&](const uint64_t &key) {
+    if (key >= 2 * num_keys) {
+      unknown++;
+    }
+  });
+  if (missing != 0 || unknown != 0) {
+    std::cerr << "The snapshot lacks " << missing << " keys, and has "
+              << unknown << " unknown keys" << std::endl;
+    ok = false;
+  }
+  unlink(path.c_str());
+  return ok ? 0 : 1;
+}
@@ -1,31 +1,167 @@
 #include "src/benchmark.h"
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 namespace benchmark {
 
-void ThreadBody(HashSetBase<int> &hash_set, size_t chunk_size, size_t id,
-                size_t &max_observed_size) {
-  max_observed_size = 0;
-  for (size_t k = 0; k < chunk_size * 2; k++) {
-    int elem = static_cast<int>(id * chunk_size + k);
-    hash_set.Add(elem);
-    max_observed_size = std::max(max_observed_size, hash_set.Size());
-  }
-  for (size_t j = 0; j < 20; j++) {
-    for (size_t k = 0; k < chunk_size * 2; k++) {
-      int elem = static_cast<int>(id * chunk_size + k);
-      if (hash_set.Contains(elem)) {
-        if ((elem % 20) == 0) {
-          hash_set.Remove(elem);
-          max_observed_size = std::max(max_observed_size, hash_set.Size());
-        }
+namespace {
+
+void PrintUsage(const char *name) {
+  std::cerr << "Usage: " << name
+            << " num_threads initial_capacity chunk_size [key_type] [flags]"
+            << std::endl;
+  std::cerr << "  key_type is one of int (default), uint64, short_string,"
+            << " long_string, large_struct" << std::endl;
+  std::cerr << "  --oversubscribe=N    run N threads per cpu, overriding"
+            << " num_threads" << std::endl;
+  std::cerr << "  --cpus=N             only run on the first N cpus"
+            << std::endl;
+  std::cerr << "  --deschedule=P       make a lock holder sleep after a"
+            << " fraction P of lock acquisitions (demo_striped and"
+            << " striped_descheduling only)" << std::endl;
+  std::cerr << "  --deschedule_us=N    length of each sleep (default 100)"
+            << std::endl;
+  std::cerr << "  --open_loop_rate=R   issue R operations per second and"
+            << " report latencies" << std::endl;
+  std::cerr << "  --sweep=N            double the open-loop rate up to N"
+            << " times, until saturation" << std::endl;
+  std::cerr << "  --duration_ms=N      length of each open-loop run"
+            << " (default 1000)" << std::endl;
+  std::cerr << "  --impl=NAME          implementation to run (hashset_bench"
+            << " only)" << std::endl;
+  std::cerr << "  --record=PATH        trace the operations to PATH"
+            << " (hashset_bench only)" << std::endl;
+}
+
+} // namespace
+
+bool SplitFlag(const std::string &arg, std::string &name, std::string &value) {
+  if (arg.rfind("--", 0) != 0) {
+    return false;
+  }
+  size_t equals = arg.find('=');
+  if (equals == std::string::npos) {
+    return false;
+  }
+  name = arg.substr(2, equals - 2);
+  value = arg.substr(equals + 1);
+  return true;
+}
+
+bool ParseOptions(int argc, char **argv, BenchmarkOptions &options) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string name;
+    std::string value;
+    if (!SplitFlag(arg, name, value)) {
+      if (arg.rfind("--", 0) == 0) {
+        PrintUsage(argv[0]);
+        return false;
       }
+      positional.push_back(arg);
+    } else if (name == "oversubscribe") {
+      options.oversubscription = std::stoul(value);
+    } else if (name == "cpus") {
+      options.cpus = std::stoul(value);
+    } else if (name == "deschedule") {
+      options.deschedule_probability = std::stod(value);
+    } else if (name == "deschedule_us") {
+      options.deschedule_length = std::chrono::microseconds(std::stoul(value));
+    } else if (name == "open_loop_rate") {
+      options.open_loop_rate = std::stod(value);
+    } else if (name == "sweep") {
+      options.sweep_steps = std::stoul(value);
+    } else if (name == "duration_ms") {
+      options.duration = std::chrono::milliseconds(std::stoul(value));
+    } else if (name == "impl") {
+      options.implementation = value;
+    } else if (name == "record") {
+      options.trace_path = value;
+    } else {
+      std::cerr << argv[0] << ": unknown flag --" << name << std::endl;
+      PrintUsage(argv[0]);
+      return false;
     }
   }
-  for (size_t k = 0; k < chunk_size * 2; k++) {
-    int elem = static_cast<int>(id * chunk_size + k);
-    hash_set.Add(elem);
-    max_observed_size = std::max(max_observed_size, hash_set.Size());
+
+  if (positional.size() != 3 && positional.size() != 4) {
+    PrintUsage(argv[0]);
+    return false;
+  }
+  options.num_threads = std::stoul(positional[0]);
+  options.initial_capacity = std::stoul(positional[1]);
+  options.chunk_size = std::stoul(positional[2]);
+  if (positional.size() == 4 &&
+      !ParseKeyType(positional[3], options.key_type)) {
+    std::cerr << argv[0] << ": unknown key type " << positional[3]
+              << std::endl;
+    return false;
+  }
+  if (options.deschedule_probability < 0.0 ||
+      options.deschedule_probability > 1.0) {
+    std::cerr << argv[0] << ": --deschedule must be between 0 and 1"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+size_t RestrictToCpus(size_t cpus) {
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return 0;
+  }
+  // Keep the first |cpus| CPUs we are allowed to run on
+  cpu_set_t restricted;
+  CPU_ZERO(&restricted);
+  size_t kept = 0;
+  for (size_t cpu = 0; cpu < CPU_SETSIZE && kept < cpus; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      CPU_SET(cpu, &restricted);
+      kept++;
+    }
+  }
+  if (kept == 0 || sched_setaffinity(0, sizeof(restricted), &restricted) != 0) {
+    return 0;
+  }
+  return kept;
+#else
+  (void)cpus;
+  return 0;
+#endif
+}
+
+bool ParseKeyType(const std::string &name, KeyType &key_type) {
+  for (KeyType candidate :
+       {KeyType::kInt, KeyType::kUint64, KeyType::kShortString,
+        KeyType::kLongString, KeyType::kLargeStruct}) {
+    if (name == KeyTypeName(candidate)) {
+      key_type = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *KeyTypeName(KeyType key_type) {
+  switch (key_type) {
+  case KeyType::kInt:
+    return "int";
+  case KeyType::kUint64:
+    return "uint64";
+  case KeyType::kShortString:
+    return "short_string";
+  case KeyType::kLongString:
+    return "long_string";
+  case KeyType::kLargeStruct:
+    return "large_struct";
   }
+  return "unknown";
 }
 
 } // namespace benchmark
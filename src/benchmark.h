@@ -4,27 +4,98 @@
 #include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include "src/benchmark_keys.h"
+#include "src/benchmark_open_loop.h"
 #include "src/hash_set_base.h"
+#include "src/hash_set_policies.h"
 
 namespace benchmark {
 
-void ThreadBody(HashSetBase<int> &hash_set, size_t chunk_size, size_t id,
-                size_t &max_observed_size);
+// Command line options shared by the demos
+struct BenchmarkOptions {
+  size_t num_threads = 0;
+  size_t initial_capacity = 0;
+  size_t chunk_size = 0;
+  KeyType key_type = KeyType::kInt;
 
-template <typename HashSetType> int RunBenchmark(int argc, char **argv) {
-  if (argc != 4) {
-    std::cerr << "Usage: " << argv[0]
-              << " num_threads initial_capacity chunk_size" << std::endl;
-    return 1;
+  // Preemption scenarios. |oversubscription|, when non-zero, replaces
+  // |num_threads| by that many threads per available CPU. |cpus|, when
+  // non-zero, restricts the process to the first |cpus| CPUs so that the
+  // OS has to time-slice the workers, lock holders included.
+  // |deschedule_probability| makes the holders of a DeschedulingLock sleep
+  // for |deschedule_length| after that fraction of acquisitions.
+  size_t oversubscription = 0;
+  size_t cpus = 0;
+  double deschedule_probability = 0.0;
+  std::chrono::microseconds deschedule_length{100};
+
+  // Open-loop mode. When |open_loop_rate| is non-zero, operations are
+  // issued at that many per second instead of back to back, over a key
+  // space of num_threads * chunk_size keys. With |sweep_steps| the rate is
+  // doubled up to that many times, stopping once the set saturates.
+  double open_loop_rate = 0.0;
+  size_t sweep_steps = 0;
+  std::chrono::milliseconds duration{1000};
+
+  // Only used by hashset_bench: the name of the implementation to run, and
+  // where to record a trace of the operations, if anywhere.
+  std::string implementation;
+  std::string trace_path;
+};
+
+// Parses "num_threads initial_capacity chunk_size [key_type] [--flags]".
+// Prints the usage and returns false on malformed arguments.
+bool ParseOptions(int argc, char **argv, BenchmarkOptions &options);
+
+// Splits "--name=value" into its parts. Returns false for other arguments.
+bool SplitFlag(const std::string &arg, std::string &name, std::string &value);
+
+// Restricts the calling process to its first |cpus| allowed CPUs, and
+// returns the number of CPUs it may run on afterwards (0 on failure).
+size_t RestrictToCpus(size_t cpus);
+
+template <typename T>
+void ThreadBody(HashSetBase<T> &hash_set, KeyGenerator<T> make_key,
+                size_t chunk_size, size_t id, size_t &max_observed_size) {
+  max_observed_size = 0;
+  for (size_t k = 0; k < chunk_size * 2; k++) {
+    size_t index = id * chunk_size + k;
+    hash_set.Add(make_key(index));
+    max_observed_size = std::max(max_observed_size, hash_set.Size());
+  }
+  for (size_t j = 0; j < 20; j++) {
+    for (size_t k = 0; k < chunk_size * 2; k++) {
+      size_t index = id * chunk_size + k;
+      T elem = make_key(index);
+      if (hash_set.Contains(elem)) {
+        if ((index % 20) == 0) {
+          hash_set.Remove(elem);
+          max_observed_size = std::max(max_observed_size, hash_set.Size());
+        }
+      }
+    }
   }
-  size_t num_threads = std::stoul(std::string(argv[1]));
-  size_t initial_capacity = std::stoul(std::string(argv[2]));
-  size_t chunk_size = std::stoul(std::string(argv[3]));
+  for (size_t k = 0; k < chunk_size * 2; k++) {
+    size_t index = id * chunk_size + k;
+    hash_set.Add(make_key(index));
+    max_observed_size = std::max(max_observed_size, hash_set.Size());
+  }
+}
 
-  HashSetType hash_set(initial_capacity);
+// Runs ThreadBody on the configured threads against |hash_set| and checks
+// the final contents.
+template <typename T>
+int RunWorkload(const char *name, HashSetBase<T> &hash_set,
+                KeyGenerator<T> make_key, const BenchmarkOptions &options) {
+  size_t num_threads = options.num_threads;
+  size_t chunk_size = options.chunk_size;
 
   std::vector<size_t> max_observed_sizes;
   max_observed_sizes.reserve(num_threads);
@@ -37,8 +108,9 @@ template <typename HashSetType> int RunBenchmark(int argc, char **argv) {
 
   auto begin_time = std::chrono::high_resolution_clock::now();
   for (size_t i = 0; i < num_threads; i++) {
-    threads.emplace_back(std::thread(ThreadBody, std::ref(hash_set), chunk_size,
-                                     i, std::ref(max_observed_sizes.at(i))));
+    threads.emplace_back(std::thread(ThreadBody<T>, std::ref(hash_set),
+                                     make_key, chunk_size, i,
+                                     std::ref(max_observed_sizes.at(i))));
   }
   for (auto &thread : threads) {
     thread.join();
@@ -51,25 +123,147 @@ template <typename HashSetType> int RunBenchmark(int argc, char **argv) {
 
   size_t expected_size = chunk_size * (num_threads + 1);
   if (hash_set.Size() != expected_size) {
-    std::cerr << argv[0] << " failed: size " << hash_set.Size()
+    std::cerr << name << " failed: size " << hash_set.Size()
               << " does not match expected size " << expected_size << std::endl;
     return 1;
   }
   for (size_t i = 0; i < chunk_size * (num_threads + 1); i++) {
-    int expected_value = static_cast<int>(i);
-    if (!hash_set.Contains(expected_value)) {
-      std::cerr << argv[0] << " failed: expected value " << expected_value
+    if (!hash_set.Contains(make_key(i))) {
+      std::cerr << name << " failed: expected value with index " << i
                 << " not found" << std::endl;
       return 1;
     }
   }
 
-  std::cout << argv[0] << " succeeded" << std::endl;
+  std::cout << name << " succeeded" << std::endl;
   std::cout << "Concurrent computation took:" << std::endl;
   std::cout << "  " << millis << " ms" << std::endl;
   return 0;
 }
 
+// Creates the hash sets of the demos by constructing HashSetType
+template <template <typename...> class HashSetType> struct ConstructorFactory {
+  template <typename T>
+  static std::unique_ptr<HashSetBase<T>> Make(const BenchmarkOptions &options) {
+    return std::make_unique<HashSetType<T>>(options.initial_capacity);
+  }
+};
+
+// Runs the open-loop workload at the configured rates, on a fresh hash
+// set for each rate, and prints the latency at each of them.
+template <typename Factory, typename T>
+int RunOpenLoopBenchmark(KeyGenerator<T> make_key,
+                         const BenchmarkOptions &options) {
+  size_t key_space = options.num_threads * options.chunk_size;
+  if (key_space == 0) {
+    std::cerr << "The open-loop key space must not be empty" << std::endl;
+    return 1;
+  }
+  PrintOpenLoopHeader();
+  double rate = options.open_loop_rate;
+  for (size_t step = 0; step <= options.sweep_steps; step++) {
+    auto hash_set = Factory::template Make<T>(options);
+    if (hash_set == nullptr) {
+      std::cerr << "Could not create a hash set with key type "
+                << KeyTypeName(options.key_type) << std::endl;
+      return 1;
+    }
+    OpenLoopResult result = RunOpenLoop<T>(*hash_set, make_key, key_space,
+                                           options.num_threads, rate,
+                                           options.duration);
+    PrintOpenLoopResult(result);
+    if (IsSaturated(result)) {
+      std::cout << "Saturated at " << result.achieved_rate << " ops/s"
+                << std::endl;
+      break;
+    }
+    rate *= 2;
+  }
+  return 0;
+}
+
+// Runs the workload on a hash set with key type T made by Factory.
+template <typename Factory, typename T>
+int RunBenchmarkWithKey(const char *name, KeyGenerator<T> make_key,
+                        const BenchmarkOptions &options) {
+  if (options.open_loop_rate > 0.0) {
+    return RunOpenLoopBenchmark<Factory, T>(make_key, options);
+  }
+  auto hash_set = Factory::template Make<T>(options);
+  if (hash_set == nullptr) {
+    std::cerr << name << ": could not create a hash set with key type "
+              << KeyTypeName(options.key_type) << std::endl;
+    return 1;
+  }
+  return RunWorkload<T>(name, *hash_set, make_key, options);
+}
+
+// Parses the command line and runs the benchmark on hash sets created by
+// Factory::Make<T>(options), for the key type T selected on the command
+// line. Factory::Make returns nullptr for key types it does not support,
+// or if it fails to create the hash set.
+template <typename Factory> int RunBenchmarkWith(int argc, char **argv) {
+  BenchmarkOptions options;
+  if (!ParseOptions(argc, argv, options)) {
+    return 1;
+  }
+
+  size_t available_cpus = std::thread::hardware_concurrency();
+  if (options.cpus != 0) {
+    available_cpus = RestrictToCpus(options.cpus);
+    if (available_cpus == 0) {
+      std::cerr << argv[0] << ": could not restrict to " << options.cpus
+                << " cpus" << std::endl;
+      return 1;
+    }
+  }
+  if (options.oversubscription != 0) {
+    options.num_threads = options.oversubscription * available_cpus;
+  }
+  std::cout << "Key type: " << KeyTypeName(options.key_type) << std::endl;
+  std::cout << "Threads: " << options.num_threads << " on " << available_cpus
+            << " cpus" << std::endl;
+  Descheduling::Configure(options.deschedule_probability,
+                          options.deschedule_length);
+
+  int result = 1;
+  switch (options.key_type) {
+  case KeyType::kInt:
+    result = RunBenchmarkWithKey<Factory, int>(argv[0], MakeIntKey, options);
+    break;
+  case KeyType::kUint64:
+    result = RunBenchmarkWithKey<Factory, uint64_t>(argv[0], MakeUint64Key,
+                                                    options);
+    break;
+  case KeyType::kShortString:
+    result = RunBenchmarkWithKey<Factory, std::string>(
+        argv[0], MakeShortStringKey, options);
+    break;
+  case KeyType::kLongString:
+    result = RunBenchmarkWithKey<Factory, std::string>(
+        argv[0], MakeLongStringKey, options);
+    break;
+  case KeyType::kLargeStruct:
+    result = RunBenchmarkWithKey<Factory, LargeKey>(argv[0], MakeLargeKey,
+                                                    options);
+    break;
+  }
+  if (options.deschedule_probability > 0.0) {
+    std::cout << "Lock holders descheduled " << Descheduling::Sleeps()
+              << " times" << std::endl;
+    if (Descheduling::Sleeps() == 0) {
+      std::cerr << argv[0] << ": --deschedule had no effect, since this set"
+                << " takes no DeschedulingLock" << std::endl;
+    }
+  }
+  return result;
+}
+
+template <template <typename...> class HashSetType>
+int RunBenchmark(int argc, char **argv) {
+  return RunBenchmarkWith<ConstructorFactory<HashSetType>>(argc, argv);
+}
+
 } // namespace benchmark
 
 #endif // BENCHMARK_H
@@ -0,0 +1,106 @@
+#ifndef BENCHMARK_KEYS_H
+#define BENCHMARK_KEYS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace benchmark {
+
+// The key types the benchmark workload can be run with.
+//
+// Production keys are mostly 20-40 byte strings, so besides int we
+// measure 64-bit integers, short strings that fit in the small string
+// buffer, long strings that need a heap allocation, and a 64-byte
+// plain-old-data struct that is expensive to copy and compare.
+enum class KeyType { kInt, kUint64, kShortString, kLongString, kLargeStruct };
+
+// Parses |name| into |key_type|. Returns false if the name is unknown.
+bool ParseKeyType(const std::string &name, KeyType &key_type);
+
+// Returns the command line name of |key_type|.
+const char *KeyTypeName(KeyType key_type);
+
+// Generates the |index|-th key of a workload. Distinct indices must give
+// distinct keys, so the workload is the same whatever the key type.
+template <typename T> using KeyGenerator = T (*)(size_t index);
+
+// A 64-byte plain-old-data key
+struct LargeKey {
+  uint64_t words[8];
+};
+
+inline bool operator==(const LargeKey &lhs, const LargeKey &rhs) {
+  for (size_t i = 0; i < 8; i++) {
+    if (lhs.words[i] != rhs.words[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool operator!=(const LargeKey &lhs, const LargeKey &rhs) {
+  return !(lhs == rhs);
+}
+
+// Orders the keys lexicographically, for sets that keep buckets sorted
+inline bool operator<(const LargeKey &lhs, const LargeKey &rhs) {
+  for (size_t i = 0; i < 8; i++) {
+    if (lhs.words[i] != rhs.words[i]) {
+      return lhs.words[i] < rhs.words[i];
+    }
+  }
+  return false;
+}
+
+inline int MakeIntKey(size_t index) { return static_cast<int>(index); }
+
+inline uint64_t MakeUint64Key(size_t index) {
+  // Spread the keys over the whole 64-bit range
+  return static_cast<uint64_t>(index) * 0x9E3779B97F4A7C15ull;
+}
+
+inline std::string MakeShortStringKey(size_t index) {
+  // At most 12 characters, so the key stays within the small string
+  // buffer of both libstdc++ (15) and libc++ (22) and never allocates.
+  return "k" + std::to_string(index);
+}
+
+inline std::string MakeLongStringKey(size_t index) {
+  // 32 characters, in the middle of the 20-40 byte range of production
+  // keys, with a long common prefix like real ones.
+  std::string digits = std::to_string(index);
+  std::string key = "session:";
+  key.append(24 - digits.size(), '0');
+  key.append(digits);
+  return key;
+}
+
+inline LargeKey MakeLargeKey(size_t index) {
+  LargeKey key{};
+  for (size_t i = 0; i < 8; i++) {
+    key.words[i] = static_cast<uint64_t>(index) + i;
+  }
+  return key;
+}
+
+} // namespace benchmark
+
+namespace std {
+
+template <> struct hash<benchmark::LargeKey> {
+  size_t operator()(const benchmark::LargeKey &key) const noexcept {
+    // FNV-1a over the words
+    uint64_t result = 0xCBF29CE484222325ull;
+    for (uint64_t word : key.words) {
+      result ^= word;
+      result *= 0x100000001B3ull;
+    }
+    return static_cast<size_t>(result);
+  }
+};
+
+} // namespace std
+
+#endif // BENCHMARK_KEYS_H
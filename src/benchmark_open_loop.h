@@ -0,0 +1,147 @@
+#ifndef BENCHMARK_OPEN_LOOP_H
+#define BENCHMARK_OPEN_LOOP_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "src/benchmark_keys.h"
+#include "src/hash_set_base.h"
+#include "src/latency_histogram.h"
+
+namespace benchmark {
+
+// What an open-loop run at one target rate achieved
+struct OpenLoopResult {
+  double target_rate = 0.0;   // Operations per second we tried to issue
+  double achieved_rate = 0.0; // Operations per second actually completed
+  LatencyHistogram latencies; // Latencies from the intended start times
+};
+
+// Issues operations on one thread following a fixed schedule.
+//
+// Operation i of thread |id| is due at start + (i * num_threads + id) /
+// rate, whether or not the previous one has completed. Latencies are
+// measured from that intended start time rather than from the moment the
+// operation was actually issued: when the hash set stalls, the operations
+// that should have been issued during the stall are charged for the wait,
+// instead of silently being issued later. This corrects for coordinated
+// omission, which makes closed-loop measurements look far better than
+// what clients see.
+template <typename T>
+void OpenLoopThreadBody(HashSetBase<T> &hash_set, KeyGenerator<T> make_key,
+                        size_t key_space, size_t id, size_t num_threads,
+                        double rate,
+                        std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end,
+                        LatencyHistogram &latencies) {
+  using Clock = std::chrono::steady_clock;
+  std::minstd_rand random(static_cast<std::minstd_rand::result_type>(id + 1));
+  double interval_nanos = 1e9 / rate;
+
+  for (uint64_t i = 0;; i++) {
+    auto offset = static_cast<int64_t>(
+        static_cast<double>(i * num_threads + id) * interval_nanos);
+    auto intended = start + std::chrono::nanoseconds(offset);
+    if (intended >= end) {
+      break;
+    }
+
+    // Sleep until shortly before the operation is due, then spin, since
+    // sleeping alone overshoots by tens of microseconds.
+    auto now = Clock::now();
+    if (intended - now > std::chrono::microseconds(200)) {
+      std::this_thread::sleep_until(intended - std::chrono::microseconds(100));
+    }
+    while (Clock::now() < intended) {
+    }
+
+    // 90% lookups, 5% inserts and 5% removals over the key space
+    auto choice = random() % 100;
+    T elem = make_key(random() % key_space);
+    if (choice < 90) {
+      (void)hash_set.Contains(elem);
+    } else if (choice < 95) {
+      hash_set.Add(elem);
+    } else {
+      hash_set.Remove(elem);
+    }
+
+    auto latency = Clock::now() - intended;
+    latencies.Record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+  }
+}
+
+// Runs the open-loop workload against |hash_set| at |rate| operations per
+// second for |duration|. Half of the |key_space| keys are inserted first.
+template <typename T>
+OpenLoopResult RunOpenLoop(HashSetBase<T> &hash_set, KeyGenerator<T> make_key,
+                           size_t key_space, size_t num_threads, double rate,
+                           std::chrono::milliseconds duration) {
+  for (size_t i = 0; i < key_space; i += 2) {
+    hash_set.Add(make_key(i));
+  }
+
+  std::vector<LatencyHistogram> latencies(num_threads);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+
+  // Leave the threads some time to start before the first operation
+  auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+  auto end = start + duration;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back(std::thread(OpenLoopThreadBody<T>, std::ref(hash_set),
+                                     make_key, key_space, i, num_threads, rate,
+                                     start, end, std::ref(latencies.at(i))));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto finished = std::chrono::steady_clock::now();
+
+  OpenLoopResult result;
+  result.target_rate = rate;
+  for (const auto &histogram : latencies) {
+    result.latencies.Merge(histogram);
+  }
+  // Operations that were due before the end but completed after it make
+  // the achieved rate fall below the target once the set saturates.
+  std::chrono::duration<double> elapsed = finished - start;
+  result.achieved_rate =
+      static_cast<double>(result.latencies.Count()) / elapsed.count();
+  return result;
+}
+
+inline void PrintOpenLoopHeader() {
+  std::cout << std::setw(14) << "target/s" << std::setw(14) << "achieved/s"
+            << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+            << std::setw(12) << "p99.9 us" << std::setw(12) << "max us"
+            << std::endl;
+}
+
+inline void PrintOpenLoopResult(const OpenLoopResult &result) {
+  auto micros = [](uint64_t nanos) {
+    return static_cast<double>(nanos) / 1000.0;
+  };
+  std::cout << std::fixed << std::setprecision(1) << std::setw(14)
+            << result.target_rate << std::setw(14) << result.achieved_rate
+            << std::setw(12) << micros(result.latencies.Percentile(50))
+            << std::setw(12) << micros(result.latencies.Percentile(99))
+            << std::setw(12) << micros(result.latencies.Percentile(99.9))
+            << std::setw(12) << micros(result.latencies.Max()) << std::endl;
+}
+
+// A run is saturated when the set can no longer keep up with the rate
+inline bool IsSaturated(const OpenLoopResult &result) {
+  return result.achieved_rate < 0.95 * result.target_rate;
+}
+
+} // namespace benchmark
+
+#endif // BENCHMARK_OPEN_LOOP_H
@@ -1,13 +1,33 @@
+#include "src/hash_set_adaptive.h"
 #include "src/hash_set_coarse_grained.h"
+#include "src/hash_set_frozen.h"
+#include "src/hash_set_lock_free_buckets.h"
+#include "src/hash_set_node_replicated.h"
+#include "src/hash_set_policies.h"
+#include "src/hash_set_recording.h"
 #include "src/hash_set_refinable.h"
+#include "src/hash_set_replicated.h"
 #include "src/hash_set_sequential.h"
+#include "src/hash_set_shared.h"
+#include "src/hash_set_static.h"
 #include "src/hash_set_striped.h"
+#include "src/hash_set_striped_buffered.h"
+#include "src/hash_set_tiered.h"
+#include "src/hash_set_wait_free_int.h"
 
 namespace check_all {
 
 void Placeholder();
 
 void Placeholder() {
+  {
+    HashSetAdaptive<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
   {
     HashSetCoarseGrained<int> hs(16);
     hs.Add(1);
@@ -16,6 +36,47 @@ void Placeholder() {
     (void)hs.Contains(1);
   }
 
+  {
+    HashSetNodeReplicated<int> hs(16, 2);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetPrimary<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    HashSetReplica<int> replica(hs);
+    (void)replica.Contains(1);
+  }
+
+  {
+    HashSetSequential<int> hs(16);
+    hs.Add(1);
+    HashSetFrozen<int> frozen = Freeze(hs, 1);
+    (void)frozen.Size();
+    (void)frozen.Contains(1);
+  }
+
+  {
+    HashSetLockFreeBuckets<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    RecordingHashSet<HashSetBase<int>> hs(
+        std::make_unique<HashSetCoarseGrained<int>>(16), "/dev/null");
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
   {
     HashSetRefinable<int> hs(16);
     hs.Add(1);
@@ -32,6 +93,20 @@ void Placeholder() {
     (void)hs.Contains(1);
   }
 
+  {
+    HashSetShared<int> hs("/hashsets_check_all", 16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    constexpr StaticHashSet<int, 2> hs({1, 2});
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
   {
     HashSetStriped<int> hs(16);
     hs.Add(1);
@@ -39,6 +114,40 @@ void Placeholder() {
     (void)hs.Size();
     (void)hs.Contains(1);
   }
+
+  {
+    HashSetStriped<int, VectorBucket<int>, std::hash<int>, SpinLock,
+                   DefaultLoadFactor, CountingStats>
+        hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetStripedBuffered<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetTiered<int> hs("/tmp/hashsets_check_all_tiered", 16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetWaitFreeInt<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
 }
 
 } // namespace check_all
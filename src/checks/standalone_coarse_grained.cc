@@ -10,6 +10,19 @@ void Placeholder() {
   hs.Remove(1);
   (void)hs.Size();
   (void)hs.Contains(1);
+
+  HashSetCoarseGrained<int> optimistic(16, true);
+  optimistic.Add(1);
+  optimistic.Remove(1);
+  (void)optimistic.Size();
+  (void)optimistic.Contains(1);
+  (void)optimistic.IsOptimistic();
+
+  HashSetCoarseGrainedSorted<int> sorted(16);
+  sorted.Add(1);
+  sorted.Remove(1);
+  (void)sorted.Size();
+  (void)sorted.Contains(1);
 }
 
 } // namespace check_coarse_grained
@@ -0,0 +1,15 @@
+#include "src/hash_set_factory.h"
+
+namespace check_factory {
+
+void Placeholder();
+
+void Placeholder() {
+  auto hs = MakeHashSet<int>("striped", 16);
+  hs->Add(1);
+  hs->Remove(1);
+  (void)hs->Size();
+  (void)hs->Contains(1);
+}
+
+} // namespace check_factory
@@ -0,0 +1,19 @@
+#include "src/hash_set_frozen.h"
+
+#include "src/hash_set_striped.h"
+
+namespace check_frozen {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetStriped<int> hs(16);
+  hs.Add(1);
+  HashSetFrozen<int, uint16_t> frozen = Freeze<int, uint16_t>(hs);
+  (void)frozen.Size();
+  (void)frozen.Contains(1);
+  (void)frozen.IndexBitsPerElement();
+  (void)frozen.Levels();
+}
+
+} // namespace check_frozen
@@ -0,0 +1,15 @@
+#include "src/hash_set_lock_free_buckets.h"
+
+namespace check_lock_free_buckets {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetLockFreeBuckets<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+}
+
+} // namespace check_lock_free_buckets
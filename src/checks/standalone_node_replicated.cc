@@ -0,0 +1,20 @@
+#include "src/hash_set_node_replicated.h"
+
+namespace check_node_replicated {
+
+void Placeholder();
+
+void Placeholder() {
+  NodeReplicated<HashSetSequential<int>> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  (void)hs.Replicas();
+  (void)hs.LogLength();
+  NumaTopology topology;
+  (void)topology.Nodes();
+  (void)topology.CurrentNode();
+}
+
+} // namespace check_node_replicated
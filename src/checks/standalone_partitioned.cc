@@ -0,0 +1,20 @@
+#include "src/partitioned_hash_set.h"
+
+namespace check_partitioned {
+
+void Placeholder();
+
+void Placeholder() {
+  PartitionedHashSet<int> hs({"/tmp/hashsets_check_partitioned.sock"});
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  (void)hs.AddBatch({1, 2});
+  (void)hs.RemoveBatch({1, 2});
+  (void)hs.ContainsBatch({1, 2});
+  (void)hs.Partitions();
+  (void)hs.Errors();
+}
+
+} // namespace check_partitioned
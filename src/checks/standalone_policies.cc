@@ -0,0 +1,24 @@
+#include "src/hash_set_policies.h"
+
+#include <functional>
+
+#include "src/hash_set_buckets.h"
+#include "src/hash_set_striped.h"
+
+namespace check_policies {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetStriped<int, VectorBucket<int>, std::hash<int>, SpinLock,
+                 LoadFactor<1, 2>, CountingStats>
+      hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  (void)hs.Statistics().Adds();
+  (void)hs.Statistics().Resizes();
+}
+
+} // namespace check_policies
@@ -0,0 +1,17 @@
+#include "src/hash_set_recording.h"
+#include "src/hash_set_striped.h"
+
+namespace check_recording {
+
+void Placeholder();
+
+void Placeholder() {
+  RecordingHashSet<HashSetStriped<int>> hs(
+      std::make_unique<HashSetStriped<int>>(16), "/dev/null");
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+}
+
+} // namespace check_recording
@@ -0,0 +1,22 @@
+#include "src/hash_set_replicated.h"
+
+namespace check_replicated {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetPrimary<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  HashSetReplica<int> replica(hs);
+  (void)replica.ApplyPending();
+  (void)replica.Size();
+  (void)replica.Contains(1);
+  (void)replica.CurrentLag();
+  (void)replica.MaxDelayNanos();
+  (void)hs.Stream().Pending();
+}
+
+} // namespace check_replicated
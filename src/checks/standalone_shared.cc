@@ -0,0 +1,19 @@
+#include "src/hash_set_shared.h"
+
+namespace check_shared {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetShared<int> hs("/hashsets_check_shared", 16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  (void)hs.Ok();
+  (void)hs.Overflows();
+  (void)hs.Repairs();
+  HashSetShared<int>::Unlink("/hashsets_check_shared");
+}
+
+} // namespace check_shared
@@ -0,0 +1,34 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/hash_set_refinable.h"
+#include "src/hash_set_striped.h"
+#include "src/snapshot.h"
+
+namespace check_snapshot {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetStriped<uint64_t> striped(16);
+  striped.Add(1);
+  std::vector<uint64_t> stripe;
+  striped.CopyStripe(striped.Stripes() - 1, stripe);
+
+  snapshot::Options options;
+  options.direct = true;
+  snapshot::Stats stats;
+  (void)snapshot::WriteSnapshot(striped, "/tmp/hashsets_check_snapshot",
+                                options, &stats);
+
+  HashSetRefinable<uint64_t> refinable(16);
+  refinable.Add(1);
+  (void)snapshot::WriteSnapshot(refinable, "/tmp/hashsets_check_snapshot");
+
+  std::string error;
+  (void)snapshot::LoadSnapshot("/tmp/hashsets_check_snapshot", refinable,
+                               error);
+}
+
+} // namespace check_snapshot
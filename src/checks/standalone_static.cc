@@ -0,0 +1,24 @@
+#include "src/hash_set_static.h"
+
+#include <string_view>
+
+namespace check_static {
+
+constexpr auto kVerbs = MakeStaticHashSet<std::string_view>(
+    {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE"});
+static_assert(kVerbs.Size() == 8);
+static_assert(kVerbs.Contains("PUT"));
+static_assert(!kVerbs.Contains("PATCH"));
+
+constexpr StaticHashSet<int, 4> kReserved({0, 1, 1024, 65535});
+static_assert(kReserved.Contains(1024));
+static_assert(!kReserved.Contains(2));
+
+void Placeholder();
+
+void Placeholder() {
+  (void)kVerbs.Contains("GET");
+  (void)kReserved.Contains(1);
+}
+
+} // namespace check_static
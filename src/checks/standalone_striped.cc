@@ -10,6 +10,19 @@ void Placeholder() {
   hs.Remove(1);
   (void)hs.Size();
   (void)hs.Contains(1);
+
+  HashSetStripedTombstone<int> tombstone(16);
+  tombstone.Add(1);
+  tombstone.Remove(1);
+  (void)tombstone.Size();
+  (void)tombstone.Contains(1);
+  tombstone.Compact();
+
+  HashSetStripedSeeded<int> seeded(16);
+  seeded.Add(1);
+  seeded.Remove(1);
+  (void)seeded.Size();
+  (void)seeded.Contains(1);
 }
 
 } // namespace check_striped
@@ -0,0 +1,16 @@
+#include "src/hash_set_striped_buffered.h"
+
+namespace check_striped_buffered {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetStripedBuffered<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  hs.Flush();
+}
+
+} // namespace check_striped_buffered
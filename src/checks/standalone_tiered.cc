@@ -0,0 +1,19 @@
+#include "src/hash_set_tiered.h"
+
+namespace check_tiered {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetTiered<int> hs("/tmp/hashsets_check_tiered", 16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  (void)hs.Ok();
+  (void)hs.InMemory();
+  (void)hs.Spills();
+  (void)hs.BlockReads();
+}
+
+} // namespace check_tiered
@@ -0,0 +1,16 @@
+#include "src/hash_set_wait_free_int.h"
+
+namespace check_wait_free_int {
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetWaitFreeInt<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+  (void)hs.Overflows();
+}
+
+} // namespace check_wait_free_int
@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_wait_free_int.h"
+
+// Adds and removes a few keys whose probe windows overlap from several
+// threads, and checks after every round that no key became a member of
+// two slots at once
+int main() {
+  constexpr size_t kThreads = 4;
+  constexpr size_t kRounds = 200;
+  constexpr size_t kOpsPerRound = 20000;
+  constexpr int kKeys = 8;
+
+  // With the minimal capacity, every key can reach every slot
+  HashSetWaitFreeInt<int> hs(16);
+  for (size_t round = 0; round < kRounds; round++) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; t++) {
+      threads.emplace_back([&hs, round, t] {
+        std::mt19937 random(static_cast<unsigned>(round * kThreads + t));
+        for (size_t op = 0; op < kOpsPerRound; op++) {
+          int key = static_cast<int>(random() % kKeys);
+          if (random() % 2 == 0) {
+            hs.Add(key);
+          } else {
+            hs.Remove(key);
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    std::map<int, size_t> members;
+    hs.ForEach([&members](const int &key) { members[key]++; });
+    size_t visited = 0;
+    for (const auto &[key, count] : members) {
+      visited += count;
+      if (count > 1) {
+        std::cerr << "Round " << round << ": key " << key << " has "
+                  << count << " members" << std::endl;
+        return 1;
+      }
+    }
+    if (visited != hs.Size()) {
+      std::cerr << "Round " << round << ": size " << hs.Size() << " but "
+                << visited << " members" << std::endl;
+      return 1;
+    }
+    for (int key = 0; key < kKeys; key++) {
+      if (hs.Contains(key) != hs.Remove(key) || hs.Contains(key)) {
+        std::cerr << "Round " << round << ": key " << key
+                  << " is still contained after its Remove" << std::endl;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
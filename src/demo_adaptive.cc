@@ -0,0 +1,6 @@
+#include "src/benchmark.h"
+#include "src/hash_set_adaptive.h"
+
+int main(int argc, char **argv) {
+  return benchmark::RunBenchmark<HashSetAdaptive>(argc, argv);
+}
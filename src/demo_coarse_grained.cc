@@ -2,5 +2,5 @@
 #include "src/hash_set_coarse_grained.h"
 
 int main(int argc, char **argv) {
-  return benchmark::RunBenchmark<HashSetCoarseGrained<int>>(argc, argv);
+  return benchmark::RunBenchmark<HashSetCoarseGrained>(argc, argv);
 }
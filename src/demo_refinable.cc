@@ -2,5 +2,5 @@
 #include "src/hash_set_refinable.h"
 
 int main(int argc, char **argv) {
-  return benchmark::RunBenchmark<HashSetRefinable<int>>(argc, argv);
+  return benchmark::RunBenchmark<HashSetRefinable>(argc, argv);
 }
@@ -0,0 +1,42 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "src/benchmark.h"
+#include "src/hash_set_shared.h"
+
+namespace {
+
+// The set cannot grow, so it is sized for all keys of the workload. Each
+// set gets a segment of its own, whose name is removed right away; the
+// mapping stays valid until the set is destroyed.
+struct SharedFactory {
+  template <typename T>
+  static std::unique_ptr<HashSetBase<T>>
+  Make(const benchmark::BenchmarkOptions &options) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      static size_t next_id = 0;
+      std::string name = "/hashsets_demo_" + std::to_string(getpid()) + "_" +
+                         std::to_string(next_id++);
+      size_t keys = (options.num_threads + 1) * options.chunk_size;
+      auto hash_set = std::make_unique<HashSetShared<T>>(
+          name, std::max(options.initial_capacity, 2 * keys));
+      HashSetShared<T>::Unlink(name);
+      if (!hash_set->Ok()) {
+        return nullptr;
+      }
+      return hash_set;
+    } else {
+      return nullptr;
+    }
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  return benchmark::RunBenchmarkWith<SharedFactory>(argc, argv);
+}
@@ -1,6 +1,26 @@
+#include <memory>
+
 #include "src/benchmark.h"
 #include "src/hash_set_striped.h"
 
+namespace {
+
+// Takes the stripe locks through DeschedulingLock only when --deschedule
+// asks for it, so that the other runs measure the plain set
+struct StripedFactory {
+  template <typename T>
+  static std::unique_ptr<HashSetBase<T>>
+  Make(const benchmark::BenchmarkOptions &options) {
+    if (options.deschedule_probability > 0.0) {
+      return std::make_unique<HashSetStripedDescheduling<T>>(
+          options.initial_capacity);
+    }
+    return std::make_unique<HashSetStriped<T>>(options.initial_capacity);
+  }
+};
+
+} // namespace
+
 int main(int argc, char **argv) {
-  return benchmark::RunBenchmark<HashSetStriped<int>>(argc, argv);
+  return benchmark::RunBenchmarkWith<StripedFactory>(argc, argv);
 }
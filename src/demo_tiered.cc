@@ -0,0 +1,42 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "src/benchmark.h"
+#include "src/hash_set_tiered.h"
+
+namespace {
+
+// Each set spills to a directory of its own. Only a quarter of the keys
+// of the workload fit in memory, so that lookups go to disk, and the
+// buckets are sized for that rather than by the initial capacity.
+struct TieredFactory {
+  template <typename T>
+  static std::unique_ptr<HashSetBase<T>>
+  Make(const benchmark::BenchmarkOptions &options) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      static size_t next_id = 0;
+      std::string directory = "/tmp/hashsets_tiered_" +
+                              std::to_string(getpid()) + "_" +
+                              std::to_string(next_id++);
+      size_t keys = (options.num_threads + 1) * options.chunk_size;
+      auto hash_set = std::make_unique<HashSetTiered<T>>(
+          directory, std::max<size_t>(keys / 4, 1));
+      if (!hash_set->Ok()) {
+        return nullptr;
+      }
+      return hash_set;
+    } else {
+      return nullptr;
+    }
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  return benchmark::RunBenchmarkWith<TieredFactory>(argc, argv);
+}
@@ -0,0 +1,29 @@
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+
+#include "src/benchmark.h"
+#include "src/hash_set_wait_free_int.h"
+
+namespace {
+
+// The set cannot grow, so it is sized for all keys of the workload
+struct WaitFreeIntFactory {
+  template <typename T>
+  static std::unique_ptr<HashSetBase<T>>
+  Make(const benchmark::BenchmarkOptions &options) {
+    if constexpr (std::is_integral_v<T> && sizeof(T) <= 4) {
+      size_t keys = (options.num_threads + 1) * options.chunk_size;
+      return std::make_unique<HashSetWaitFreeInt<T>>(
+          std::max(options.initial_capacity, 2 * keys));
+    } else {
+      return nullptr;
+    }
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  return benchmark::RunBenchmarkWith<WaitFreeIntFactory>(argc, argv);
+}
@@ -0,0 +1,255 @@
+#ifndef HASH_SET_ADAPTIVE_H
+#define HASH_SET_ADAPTIVE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_striped.h"
+
+template <typename T> class HashSetAdaptive : public HashSetBase<T> {
+private:
+  // Per-stripe contention counters, only touched under the stripe's lock.
+  // Each stripe gets its own cache line, so that counting does not add
+  // sharing between stripes.
+  struct alignas(64) StripeStats {
+    size_t operations = 0;       // Operations in the current window
+    size_t contended = 0;        // Of which found the mutex already held
+    size_t hand_overs = 0;       // Of which came from another thread
+    std::thread::id last_thread; // The thread of the last operation
+  };
+
+  // Number of operations on a stripe between two mode decisions
+  static constexpr size_t kWindow = 1024;
+  // Switch to striped locking when more than 1 in kContendedRatio
+  // operations has to wait for the single lock.
+  static constexpr size_t kContendedRatio = 20;
+  // A stripe is quiet when fewer than 1 in kQuietRatio operations come
+  // from another thread than the previous one.
+  static constexpr size_t kQuietRatio = 100;
+
+  std::vector<std::vector<T>> table_;    // A vector of vectors for storage
+  std::mutex *mutexes_;                  // An array of mutexes
+  std::unique_ptr<StripeStats[]> stats_; // Counters for each mutex
+  size_t mutex_count_;                   // The number of elements in the array
+  std::atomic<size_t> active_count_;     // Mutexes in use: 1 or mutex_count_
+  std::atomic<size_t> quiet_windows_;    // Quiet windows since a busy one
+  size_t capacity_;                      // The number of buckets
+  std::atomic<size_t> size_;             // The number of elements
+
+  // Most of our sets are used by a single thread for most of the day, and
+  // by many threads at peak. A single lock is the cheapest option in the
+  // first case, and lock striping in the second, so this set switches
+  // between the two at runtime.
+  //
+  // The table is the same in both modes: bucket i is protected by mutex
+  // i % active_count_, so with a single active mutex this behaves like
+  // HashSetCoarseGrained and otherwise like HashSetStriped. Changing mode
+  // or capacity holds all of the mutexes, so an operation that holds its
+  // mutex and still sees the same active_count_ can use the table.
+  //
+  // The set starts with the single lock, and moves to striping when
+  // many operations find that lock already held. It moves back when most
+  // stripes see their operations come in long runs from a single thread,
+  // which is what a single lock handles best.
+
+public:
+  // Initialize the capacity and initialise the table
+  explicit HashSetAdaptive(size_t initial_capacity)
+      : table_(std::vector<std::vector<T>>(initial_capacity, std::vector<T>())),
+        mutexes_(new std::mutex[initial_capacity]),
+        stats_(new StripeStats[initial_capacity]),
+        mutex_count_(initial_capacity), active_count_(1), quiet_windows_(0),
+        capacity_(initial_capacity), size_(0) {}
+
+  ~HashSetAdaptive() override { delete[] mutexes_; }
+
+  HashSetAdaptive(const HashSetAdaptive &) = delete;
+  HashSetAdaptive &operator=(const HashSetAdaptive &) = delete;
+
+  // Add an element to the hash set
+  bool Add(T elem) final {
+    // If the average bucket size is 4, increase size.
+    // Resizing happens at the beginning of Add, so we don't have to
+    // explicitly drop the lock acquired during add.
+    if (size_ > 4 * capacity_) {
+      resize();
+    }
+
+    size_t hash = std::hash<T>()(elem);
+    size_t switch_to = 0;
+    bool added = false;
+    {
+      std::unique_lock<std::mutex> lock = LockFor(hash, switch_to);
+
+      // If the element is not already contained, add it to its bucket
+      std::vector<T> &bucket = table_[hash % capacity_];
+      auto it = std::find(bucket.begin(), bucket.end(), elem);
+      if (it == bucket.end()) {
+        bucket.push_back(elem);
+        size_.fetch_add(1);
+        added = true;
+      }
+    }
+    MaybeSwitch(switch_to);
+    return added;
+  }
+
+  // Remove an element from the hashset
+  bool Remove(T elem) final {
+    size_t hash = std::hash<T>()(elem);
+    size_t switch_to = 0;
+    bool removed = false;
+    {
+      std::unique_lock<std::mutex> lock = LockFor(hash, switch_to);
+
+      // If the element is included, erase it
+      std::vector<T> &bucket = table_[hash % capacity_];
+      auto it = std::find(bucket.begin(), bucket.end(), elem);
+      if (it != bucket.end()) {
+        bucket.erase(it);
+        size_.fetch_sub(1);
+        removed = true;
+      }
+    }
+    MaybeSwitch(switch_to);
+    return removed;
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] bool Contains(T elem) final {
+    size_t hash = std::hash<T>()(elem);
+    size_t switch_to = 0;
+    bool found = false;
+    {
+      std::unique_lock<std::mutex> lock = LockFor(hash, switch_to);
+
+      std::vector<T> &bucket = table_[hash % capacity_];
+      found = std::find(bucket.begin(), bucket.end(), elem) != bucket.end();
+    }
+    MaybeSwitch(switch_to);
+    return found;
+  }
+
+  // Get the size of the hashset
+  [[nodiscard]] size_t Size() const final { return size_.load(); }
+
+  // Call |f| on every element, holding all of the mutexes
+  void ForEach(const std::function<void(const T &)> &f) final {
+    ArrayLock<std::mutex> al(mutexes_, mutex_count_);
+    for (const auto &bucket : table_) {
+      for (const T &elem : bucket) {
+        f(elem);
+      }
+    }
+  }
+
+  // Returns true if the set currently uses lock striping
+  [[nodiscard]] bool IsStriped() const { return active_count_.load() != 1; }
+
+private:
+  // Acquires the mutex protecting the bucket of |hash| in the current mode,
+  // and updates its counters. If they call for a change of mode, sets
+  // |switch_to| to the new number of active mutexes; the caller must then
+  // call MaybeSwitch once it has released the lock.
+  std::unique_lock<std::mutex> LockFor(size_t hash, size_t &switch_to) {
+    while (true) {
+      size_t active = active_count_.load();
+      size_t index = hash % active;
+      std::unique_lock<std::mutex> lock(mutexes_[index], std::try_to_lock);
+      bool contended = !lock.owns_lock();
+      if (contended) {
+        lock.lock();
+      }
+      // If the mode changed while we waited, the mutex may be the wrong one
+      if (active_count_.load() != active) {
+        continue;
+      }
+
+      StripeStats &stats = stats_[index];
+      std::thread::id this_thread = std::this_thread::get_id();
+      stats.operations++;
+      if (contended) {
+        stats.contended++;
+      }
+      if (stats.last_thread != this_thread) {
+        stats.hand_overs++;
+        stats.last_thread = this_thread;
+      }
+      if (stats.operations == kWindow) {
+        switch_to = Decide(stats, active);
+        stats = StripeStats();
+      }
+      return lock;
+    }
+  }
+
+  // Called at the end of a stripe's window. Returns the number of mutexes
+  // to switch to, or 0 to stay in the current mode.
+  size_t Decide(const StripeStats &stats, size_t active) {
+    if (active == 1) {
+      bool contended = stats.contended * kContendedRatio > stats.operations;
+      return contended ? mutex_count_ : 0;
+    }
+    if (stats.hand_overs * kQuietRatio >= stats.operations) {
+      quiet_windows_.store(0);
+      return 0;
+    }
+    // Only go back to a single lock once most stripes have been quiet
+    if (quiet_windows_.fetch_add(1) + 1 < (mutex_count_ + 1) / 2) {
+      return 0;
+    }
+    return 1;
+  }
+
+  // Switches to |switch_to| active mutexes, unless it is 0 or the mode is
+  // already right.
+  void MaybeSwitch(size_t switch_to) {
+    if (switch_to == 0 || mutex_count_ == 1) {
+      return;
+    }
+    ArrayLock<std::mutex> al(mutexes_, mutex_count_);
+    if (active_count_.load() == switch_to) {
+      return;
+    }
+    active_count_.store(switch_to);
+    quiet_windows_.store(0);
+    for (size_t i = 0; i < mutex_count_; i++) {
+      stats_[i] = StripeStats();
+    }
+  }
+
+  // Double the size of the hashset
+  void resize() {
+    size_t old_capacity = capacity_;
+
+    // Acquire all of the locks, so that neither the mode nor the table
+    // can change under us
+    ArrayLock<std::mutex> al(mutexes_, mutex_count_);
+
+    // Check if someone else has already resized
+    if (capacity_ != old_capacity) {
+      return;
+    }
+    capacity_ *= 2;
+
+    // Create a new, bigger table
+    std::vector<std::vector<T>> new_table(capacity_, std::vector<T>());
+    // Move all old table elements to new one
+    for (auto &bucket : table_) {
+      for (T curr_elem : bucket) {
+        size_t curr_hash = std::hash<T>()(curr_elem) % capacity_;
+        new_table[curr_hash].push_back(curr_elem);
+      }
+    }
+    table_ = new_table;
+  }
+};
+
+#endif // HASH_SET_ADAPTIVE_H
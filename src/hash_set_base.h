@@ -2,6 +2,7 @@
 #define HASH_SET_BASE_H
 
 #include <cstddef>
+#include <functional>
 
 template <typename T> class HashSetBase {
 public:
@@ -20,6 +21,18 @@ public:
 
   // Returns the size of the hash set.
   [[nodiscard]] virtual size_t Size() const = 0;
+
+  // Calls |f| on every element of the hash set. Elements added or removed
+  // concurrently may or may not be visited.
+  virtual void ForEach(const std::function<void(const T &)> &f) = 0;
+};
+
+// The element type of a hash set class, e.g. int for HashSetStriped<int>
+template <typename HashSet> struct HashSetElement;
+
+template <template <typename...> class HashSet, typename T, typename... Rest>
+struct HashSetElement<HashSet<T, Rest...>> {
+  using Type = T;
 };
 
 #endif // HASH_SET_BASE_H
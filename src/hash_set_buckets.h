@@ -0,0 +1,216 @@
+#ifndef HASH_SET_BUCKETS_H
+#define HASH_SET_BUCKETS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Bucket types for the hash sets that take one as a template parameter.
+//
+// A bucket holds the elements of one hash value modulo the capacity, and
+// is only used while its lock is held. Each type provides:
+// - Contains(elem), Insert(elem) and Erase(elem), which return whether
+//   |elem| was present, absent and present respectively;
+// - Append(elem), which adds an element known to be absent, for resizing;
+// - ForEach(f), which calls f on every element;
+// - kLazyErase, which is true if Erase leaves garbage behind that
+//   Compact() reclaims.
+
+// An unordered vector, from which Erase removes elements in place. This
+// is the bucket the sets have always used.
+template <typename T> class VectorBucket {
+private:
+  std::vector<T> elems_; // The elements, in insertion order
+
+public:
+  static constexpr bool kLazyErase = false;
+
+  // Check if an element is contained in the bucket
+  [[nodiscard]] bool Contains(const T &elem) const {
+    return std::find(elems_.begin(), elems_.end(), elem) != elems_.end();
+  }
+
+  // Add an element, unless the bucket contains it already
+  bool Insert(const T &elem) {
+    if (Contains(elem)) {
+      return false;
+    }
+    elems_.push_back(elem);
+    return true;
+  }
+
+  // Remove an element, shifting the ones after it
+  bool Erase(const T &elem) {
+    auto it = std::find(elems_.begin(), elems_.end(), elem);
+    if (it == elems_.end()) {
+      return false;
+    }
+    elems_.erase(it);
+    return true;
+  }
+
+  // Add an element that the bucket does not contain
+  void Append(const T &elem) { elems_.push_back(elem); }
+
+  // Call |f| on every element
+  template <typename F> void ForEach(F f) const {
+    for (const T &elem : elems_) {
+      f(elem);
+    }
+  }
+
+  // Nothing to reclaim
+  void Compact() {}
+};
+
+// A vector in which Erase only marks the element's slot as dead, so that
+// removing never moves other elements. Insert reuses the first dead slot
+// it finds, and Compact drops the remaining ones.
+template <typename T> class TombstoneBucket {
+private:
+  struct Slot {
+    T elem;    // The element, or a removed one if not live
+    bool live; // False once the element was removed
+  };
+
+  std::vector<Slot> slots_; // The live and dead slots
+
+public:
+  static constexpr bool kLazyErase = true;
+
+  // Check if an element is contained in the bucket
+  [[nodiscard]] bool Contains(const T &elem) const {
+    return std::any_of(slots_.begin(), slots_.end(), [&](const Slot &slot) {
+      return slot.live && slot.elem == elem;
+    });
+  }
+
+  // Add an element, unless the bucket contains it already
+  bool Insert(const T &elem) {
+    Slot *dead = nullptr;
+    for (Slot &slot : slots_) {
+      if (!slot.live) {
+        dead = dead == nullptr ? &slot : dead;
+      } else if (slot.elem == elem) {
+        return false;
+      }
+    }
+    if (dead != nullptr) {
+      *dead = Slot{elem, true};
+    } else {
+      slots_.push_back(Slot{elem, true});
+    }
+    return true;
+  }
+
+  // Remove an element by marking its slot as dead
+  bool Erase(const T &elem) {
+    for (Slot &slot : slots_) {
+      if (slot.live && slot.elem == elem) {
+        slot.live = false;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Add an element that the bucket does not contain
+  void Append(const T &elem) { slots_.push_back(Slot{elem, true}); }
+
+  // Call |f| on every live element
+  template <typename F> void ForEach(F f) const {
+    for (const Slot &slot : slots_) {
+      if (slot.live) {
+        f(slot.elem);
+      }
+    }
+  }
+
+  // Drop the dead slots
+  void Compact() {
+    slots_.erase(std::remove_if(slots_.begin(), slots_.end(),
+                                [](const Slot &slot) { return !slot.live; }),
+                 slots_.end());
+  }
+};
+
+// A vector that is kept sorted once it grows past |kSortThreshold|
+// elements, so that lookups in long buckets use a binary search. Buckets
+// hold 4 elements on average, but keys that std::hash maps to the same
+// bucket, such as patterned integers under the identity hash, can pile
+// thousands of elements into one. Requires T to be ordered by std::less.
+template <typename T, size_t kSortThreshold = 16> class SortedBucket {
+private:
+  std::vector<T> elems_; // The elements, sorted if sorted_
+  bool sorted_ = false;  // Set once the bucket outgrew kSortThreshold
+
+public:
+  static constexpr bool kLazyErase = false;
+
+  // Check if an element is contained in the bucket
+  [[nodiscard]] bool Contains(const T &elem) const {
+    if (sorted_) {
+      return std::binary_search(elems_.begin(), elems_.end(), elem,
+                                std::less<T>());
+    }
+    return std::find(elems_.begin(), elems_.end(), elem) != elems_.end();
+  }
+
+  // Add an element, unless the bucket contains it already
+  bool Insert(const T &elem) {
+    if (sorted_) {
+      auto it = std::lower_bound(elems_.begin(), elems_.end(), elem,
+                                 std::less<T>());
+      if (it != elems_.end() && *it == elem) {
+        return false;
+      }
+      elems_.insert(it, elem);
+      return true;
+    }
+    if (std::find(elems_.begin(), elems_.end(), elem) != elems_.end()) {
+      return false;
+    }
+    Append(elem);
+    return true;
+  }
+
+  // Remove an element, keeping the others in order
+  bool Erase(const T &elem) {
+    auto it = sorted_ ? std::lower_bound(elems_.begin(), elems_.end(), elem,
+                                         std::less<T>())
+                      : std::find(elems_.begin(), elems_.end(), elem);
+    if (it == elems_.end() || !(*it == elem)) {
+      return false;
+    }
+    elems_.erase(it);
+    return true;
+  }
+
+  // Add an element that the bucket does not contain
+  void Append(const T &elem) {
+    if (sorted_) {
+      elems_.insert(std::upper_bound(elems_.begin(), elems_.end(), elem,
+                                     std::less<T>()),
+                    elem);
+      return;
+    }
+    elems_.push_back(elem);
+    if (elems_.size() > kSortThreshold) {
+      std::sort(elems_.begin(), elems_.end(), std::less<T>());
+      sorted_ = true;
+    }
+  }
+
+  // Call |f| on every element
+  template <typename F> void ForEach(F f) const {
+    for (const T &elem : elems_) {
+      f(elem);
+    }
+  }
+
+  // Nothing to reclaim
+  void Compact() {}
+};
+
+#endif // HASH_SET_BUCKETS_H
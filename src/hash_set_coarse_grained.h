@@ -2,23 +2,39 @@
 #define HASH_SET_COARSE_GRAINED_H
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
 #include <vector>
 
 #include "src/hash_set_base.h"
+#include "src/hash_set_buckets.h"
 
-template <typename T> class HashSetCoarseGrained : public HashSetBase<T> {
+template <typename T, typename Bucket = VectorBucket<T>>
+class HashSetCoarseGrained : public HashSetBase<T> {
 private:
-  std::vector<std::vector<T>> table_; // A vector of vectors for storage
+  // Optimistic attempts before an operation falls back to the mutex
+  static constexpr int kMaxAttempts = 16;
+
+  std::vector<Bucket> table_;         // A vector of buckets for storage
   std::mutex mutex_;                  // A coarse grained mutex
-  size_t capacity_;                   // The number of buckets
-  size_t size_ = 0;                   // The number of elements
+  std::atomic<size_t> capacity_;      // The number of buckets
+  std::atomic<size_t> size_ = 0;      // The number of elements
+
+  // Only used in optimistic mode
+  bool optimistic_;                                   // The mode of the set
+  std::atomic<uint64_t> global_version_ = 0;          // Odd while resizing
+  std::unique_ptr<std::atomic<uint64_t>[]> versions_; // Per-bucket words
+  size_t version_count_;                              // Length of versions_
 
-  // size and capacity are only changed by one thread at a time,
-  // so there is no need for atomic variables.
+  // size and capacity are only changed by one thread at a time in the
+  // default mode, but optimistic operations read them without the mutex,
+  // so they are atomic.
 
   // For the coarse grained lock, I am using a simple mutex.
   //
@@ -29,29 +45,48 @@ private:
   // in paralell would be good, but in practice, the overhead
   // from using a complex locking mechanism outweighs its
   // advantages. Here, we have an about constant time lookup.
+  //
+  // The single mutex also serializes operations on different buckets,
+  // which do not conflict. In optimistic mode, operations do not take
+  // the mutex. Instead, they check that the global version is even (no
+  // resize is in progress), claim the version word of their bucket by
+  // making it odd, check that the global version has not changed, and
+  // run on the bucket. Only when the word is claimed by someone else
+  // for kMaxAttempts tries does an operation take the mutex, and a resize
+  // always takes it.
+  //
+  // Bucket i has version word i % version_count_, which stays the same
+  // across resizes since the capacity only doubles. Claiming the word is
+  // needed for lookups too, since a bucket cannot be read while another
+  // thread may reallocate it.
 
 public:
-  // Initialize the capacity and initialise the table
-  explicit HashSetCoarseGrained(size_t initial_capacity)
-      : table_(std::vector<std::vector<T>>(initial_capacity, std::vector<T>())),
-        capacity_(initial_capacity) {}
+  // Initialize the capacity and initialise the table. If |optimistic|,
+  // operations run without the mutex unless they conflict.
+  explicit HashSetCoarseGrained(size_t initial_capacity,
+                                bool optimistic = false)
+      : table_(std::vector<Bucket>(initial_capacity)),
+        capacity_(initial_capacity), optimistic_(optimistic),
+        versions_(optimistic ? new std::atomic<uint64_t>[initial_capacity]()
+                             : nullptr),
+        version_count_(optimistic ? initial_capacity : 0) {}
 
   // Add an element to the hash set
   bool Add(T elem) final {
+    if (optimistic_) {
+      return OptimisticAdd(elem);
+    }
+
     // Acquire the mutex using a scoped lock
     std::scoped_lock<std::mutex> lock(mutex_);
     // std::unique_lock<std::shared_mutex> lock(mutex_);
 
     size_t hash = std::hash<T>()(elem) % capacity_;
 
-    // If the element is already contained, return false.
-    auto it = std::find(table_[hash].begin(), table_[hash].end(), elem);
-    if (it != table_[hash].end()) {
+    // Add the element to the correct bucket, unless it is already there
+    if (!table_[hash].Insert(elem)) {
       return false;
     }
-
-    // Add element to the correct bucket
-    table_[hash].push_back(elem);
     size_++;
 
     // If the average bucket size is 4, increase size.
@@ -59,18 +94,7 @@ public:
     // We do not need to double check the size for change as
     // in the book, since we are still holding the one lock
     if (size_ > 4 * capacity_) {
-      capacity_ *= 2;
-      // Create a new, bigger table
-      std::vector<std::vector<T>> new_table(capacity_, std::vector<T>());
-      // Move all old table elements to new one
-      for (auto &bucket : table_) {
-        for (T curr_elem : bucket) {
-          size_t curr_hash = std::hash<T>()(curr_elem) % capacity_;
-          new_table[curr_hash].push_back(curr_elem);
-        }
-      }
-      // Set old table to the new one
-      table_ = new_table;
+      resize();
     }
 
     // Return true for successful operation
@@ -79,25 +103,36 @@ public:
 
   // Remove an element from the hashset
   bool Remove(T elem) final {
+    if (optimistic_) {
+      return Optimistic(elem, [this, &elem](Bucket &bucket) {
+        if (!bucket.Erase(elem)) {
+          return false;
+        }
+        size_.fetch_sub(1);
+        return true;
+      });
+    }
+
     // Acquire the mutex using a scoped lock
     std::scoped_lock<std::mutex> lock(mutex_);
     // std::unique_lock<std::shared_mutex> lock(mutex_);
 
     size_t hash = std::hash<T>()(elem) % capacity_;
-    // If the element is not included, return false
-    auto it = std::find(table_[hash].begin(), table_[hash].end(), elem);
-    if (it == table_[hash].end()) {
+    // Erase the element, if it is included
+    if (!table_[hash].Erase(elem)) {
       return false;
     }
-
-    // Erase the element
-    table_[hash].erase(it);
     size_--;
     return true;
   }
 
   // Check if an element is contained in the hashset
   [[nodiscard]] bool Contains(T elem) final {
+    if (optimistic_) {
+      return Optimistic(
+          elem, [&elem](Bucket &bucket) { return bucket.Contains(elem); });
+    }
+
     // Acquire the mutex using a scoped lock
     std::scoped_lock<std::mutex> lock(mutex_);
     // std::shared_lock<std::shared_mutex> lock(mutex_);
@@ -105,15 +140,140 @@ public:
     // If we have a lot of lookups, a binary search algorithm
     // might be a little faster, however, due to resizing,
     // this will contain an average of 4 elements making it O(1).
+    // Keys that hash badly can still pile up in one bucket; use
+    // SortedBucket to binary search long buckets.
     size_t hash = std::hash<T>()(elem) % capacity_;
-    auto it = std::find(table_[hash].begin(), table_[hash].end(), elem);
 
     // Return if the element was found
-    return it != table_[hash].end();
+    return table_[hash].Contains(elem);
   }
 
   // Get the size of the hashset
-  [[nodiscard]] size_t Size() const final { return size_; }
+  [[nodiscard]] size_t Size() const final { return size_.load(); }
+
+  // Call |f| on every element, holding the mutex
+  void ForEach(const std::function<void(const T &)> &f) final {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    if (optimistic_) {
+      PauseOptimistic();
+    }
+    for (const auto &bucket : table_) {
+      bucket.ForEach([&f](const T &elem) { f(elem); });
+    }
+    if (optimistic_) {
+      global_version_.fetch_add(1);
+    }
+  }
+
+  // Returns true if the set runs operations optimistically
+  [[nodiscard]] bool IsOptimistic() const { return optimistic_; }
+
+private:
+  bool OptimisticAdd(const T &elem) {
+    // Resize before claiming a bucket, like HashSetStriped
+    size_t old_capacity = capacity_.load();
+    if (size_ > 4 * old_capacity) {
+      std::scoped_lock<std::mutex> lock(mutex_);
+      if (capacity_.load() == old_capacity) {
+        resize();
+      }
+    }
+    return Optimistic(elem, [this, &elem](Bucket &bucket) {
+      if (!bucket.Insert(elem)) {
+        return false;
+      }
+      size_.fetch_add(1);
+      return true;
+    });
+  }
+
+  // Runs |operation| on the bucket of |elem| in optimistic mode, and
+  // returns its result.
+  template <typename Operation>
+  bool Optimistic(const T &elem, Operation operation) {
+    size_t hash = std::hash<T>()(elem);
+    std::atomic<uint64_t> &version = versions_[hash % version_count_];
+
+    for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+      uint64_t global = global_version_.load();
+      if (global % 2 == 1) {
+        // A resize is in progress
+        std::this_thread::yield();
+        continue;
+      }
+      uint64_t current = version.load();
+      if (current % 2 == 1 ||
+          !version.compare_exchange_strong(current, current + 1)) {
+        // Another operation is on a bucket with the same word
+        continue;
+      }
+      if (global_version_.load() != global) {
+        // A resize started before we claimed the word, and may be moving
+        // the bucket
+        version.store(current + 2);
+        continue;
+      }
+      bool result = operation(table_[hash % capacity_.load()]);
+      version.store(current + 2);
+      return result;
+    }
+
+    // On conflict, queue up on the mutex. Resizing also holds the mutex,
+    // so only the word has to be claimed.
+    std::scoped_lock<std::mutex> lock(mutex_);
+    while (true) {
+      uint64_t current = version.load();
+      if (current % 2 == 0 &&
+          version.compare_exchange_weak(current, current + 1)) {
+        bool result = operation(table_[hash % capacity_.load()]);
+        version.store(current + 2);
+        return result;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // Make the global version odd, so that no new optimistic operation
+  // claims a word, then wait for the operations in progress to finish.
+  // The mutex must be held, and the global version made even again.
+  void PauseOptimistic() {
+    global_version_.fetch_add(1);
+    for (size_t i = 0; i < version_count_; i++) {
+      while (versions_[i].load() % 2 == 1) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  // Double the size of the hashset. The mutex must be held.
+  void resize() {
+    if (optimistic_) {
+      PauseOptimistic();
+    }
+
+    size_t new_capacity = capacity_.load() * 2;
+    // Create a new, bigger table
+    std::vector<Bucket> new_table(new_capacity);
+    // Move all old table elements to new one
+    for (auto &bucket : table_) {
+      bucket.ForEach([&](const T &curr_elem) {
+        size_t curr_hash = std::hash<T>()(curr_elem) % new_capacity;
+        new_table[curr_hash].Append(curr_elem);
+      });
+    }
+    // Set old table to the new one
+    table_ = new_table;
+    capacity_.store(new_capacity);
+
+    if (optimistic_) {
+      global_version_.fetch_add(1);
+    }
+  }
 };
 
+// A HashSetCoarseGrained that binary searches long buckets, for keys that
+// do not hash well
+template <typename T>
+using HashSetCoarseGrainedSorted = HashSetCoarseGrained<T, SortedBucket<T>>;
+
 #endif // HASH_SET_COARSE_GRAINED_H
@@ -0,0 +1,112 @@
+#ifndef HASH_SET_FACTORY_H
+#define HASH_SET_FACTORY_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "src/hash_set_adaptive.h"
+#include "src/hash_set_base.h"
+#include "src/hash_set_coarse_grained.h"
+#include "src/hash_set_lock_free_buckets.h"
+#include "src/hash_set_node_replicated.h"
+#include "src/hash_set_recording.h"
+#include "src/hash_set_refinable.h"
+#include "src/hash_set_sequential.h"
+#include "src/hash_set_striped.h"
+
+// Options applying to any implementation created by MakeHashSet
+struct HashSetOptions {
+  // When non-empty, the set is wrapped in a RecordingHashSet that traces
+  // its operations to this file.
+  std::string trace_path;
+};
+
+// The implementations MakeHashSet can create, by name.
+//
+// To make a new implementation selectable at runtime, add it to kEntries;
+// its class template must take the key type and an initial capacity.
+template <typename T> struct HashSetRegistry {
+  struct Entry {
+    const char *name;                                // Name in configs
+    bool thread_safe;                                // Concurrent use is ok
+    std::unique_ptr<HashSetBase<T>> (*make)(size_t); // Constructs one
+  };
+
+  template <template <typename...> class HashSetType>
+  static std::unique_ptr<HashSetBase<T>> Construct(size_t initial_capacity) {
+    return std::make_unique<HashSetType<T>>(initial_capacity);
+  }
+
+  static std::unique_ptr<HashSetBase<T>>
+  ConstructOptimistic(size_t initial_capacity) {
+    return std::make_unique<HashSetCoarseGrained<T>>(initial_capacity, true);
+  }
+
+  static constexpr Entry kEntries[] = {
+      {"sequential", false, Construct<HashSetSequential>},
+      {"coarse_grained", true, Construct<HashSetCoarseGrained>},
+      {"coarse_grained_optimistic", true, ConstructOptimistic},
+      {"coarse_grained_sorted", true, Construct<HashSetCoarseGrainedSorted>},
+      {"striped", true, Construct<HashSetStriped>},
+      {"refinable", true, Construct<HashSetRefinable>},
+      {"adaptive", true, Construct<HashSetAdaptive>},
+      {"striped_tombstone", true, Construct<HashSetStripedTombstone>},
+      {"striped_seeded", true, Construct<HashSetStripedSeeded>},
+      {"striped_descheduling", true, Construct<HashSetStripedDescheduling>},
+      {"lock_free_buckets", true, Construct<HashSetLockFreeBuckets>},
+      {"node_replicated", true, Construct<HashSetNodeReplicated>},
+  };
+
+  // Returns the entry called |name|, or nullptr if there is none
+  static const Entry *Find(const std::string &name) {
+    for (const Entry &entry : kEntries) {
+      if (name == entry.name) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // Returns the names of all entries, separated by commas
+  static std::string Names() {
+    std::string names;
+    for (const Entry &entry : kEntries) {
+      names += names.empty() ? "" : ", ";
+      names += entry.name;
+    }
+    return names;
+  }
+};
+
+// Creates the implementation called |name|, such as "striped", with
+// |initial_capacity| buckets. Returns nullptr if the name is unknown, or
+// if the trace file of options.trace_path could not be created.
+template <typename T>
+std::unique_ptr<HashSetBase<T>>
+MakeHashSet(const std::string &name, size_t initial_capacity,
+            const HashSetOptions &options = {}) {
+  const auto *entry = HashSetRegistry<T>::Find(name);
+  if (entry == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<HashSetBase<T>> hash_set = entry->make(initial_capacity);
+  if (!options.trace_path.empty()) {
+    auto recording = std::make_unique<RecordingHashSet<HashSetBase<T>>>(
+        std::move(hash_set), options.trace_path);
+    if (!recording->Ok()) {
+      return nullptr;
+    }
+    hash_set = std::move(recording);
+  }
+  return hash_set;
+}
+
+// Returns true if |name| is an implementation that may be used by several
+// threads at once, and false if it is sequential or unknown.
+template <typename T> bool IsThreadSafeHashSet(const std::string &name) {
+  const auto *entry = HashSetRegistry<T>::Find(name);
+  return entry != nullptr && entry->thread_safe;
+}
+
+#endif // HASH_SET_FACTORY_H
@@ -0,0 +1,263 @@
+#ifndef HASH_SET_FROZEN_H
+#define HASH_SET_FROZEN_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_static.h"
+
+// An immutable set, built from a snapshot of another one, that stores a
+// minimal perfect hash function of the elements and a fingerprint of each
+// of them instead of the elements themselves.
+//
+// The hash function is BBHash: a cascade of bit arrays, about gamma bits
+// per remaining element each. An element is hashed to one bit of the
+// first array, and keeps it if no other element hashed there; the
+// elements that collided move on to the next array. The elements are
+// numbered by the rank of their bit among all set bits, which a table of
+// counts per 512 bits answers in a few popcounts. With gamma = 1 this
+// costs about 3.5 bits per element. Building a level hashes all
+// remaining elements on |threads| threads, setting bits with atomic ORs.
+//
+// Contains compares the fingerprint of the element with the one stored
+// at its number, so an element that was not in the set is reported as
+// present with probability 2^-bits of Fingerprint. Elements whose 64-bit
+// hashes collide cannot be told apart, and are kept in a sorted fallback
+// list once kMaxLevels levels did not separate them.
+template <typename T, typename Fingerprint = uint8_t,
+          typename Hash = std::hash<T>>
+class HashSetFrozen {
+  static_assert(std::is_unsigned_v<Fingerprint>,
+                "Fingerprint must be an unsigned integer type");
+
+private:
+  // Levels built before the remaining elements go to the fallback list
+  static constexpr size_t kMaxLevels = 64;
+  // Returned by Find for elements that were not in the set
+  static constexpr size_t kNotFound = std::numeric_limits<size_t>::max();
+
+  struct Level {
+    size_t offset; // The first bit of the level in bits_
+    size_t size;   // The number of bits of the level, a multiple of 64
+  };
+
+  std::vector<uint64_t> bits_;            // The bit arrays of all levels
+  std::vector<uint64_t> ranks_;           // Set bits before each 512 bits
+  std::vector<Level> levels_;             // Where each level is in bits_
+  std::vector<uint64_t> fallback_;        // Sorted hashes of the rest
+  std::vector<Fingerprint> fingerprints_; // By element number
+  size_t size_;                           // The number of elements
+  Hash hash_;                             // Hashes the elements
+
+public:
+  // Freeze the elements of |hash_set|, building on |threads| threads with
+  // |gamma| bits per element and level. Larger gammas build and look up
+  // faster, using more memory.
+  explicit HashSetFrozen(HashSetBase<T> &hash_set, size_t threads = 0,
+                         double gamma = 1.0)
+      : size_(0) {
+    if (threads == 0) {
+      threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    std::vector<uint64_t> hashes;
+    hashes.reserve(hash_set.Size());
+    hash_set.ForEach([this, &hashes](const T &elem) {
+      hashes.push_back(static_cast<uint64_t>(hash_(elem)));
+    });
+    size_ = hashes.size();
+    Build(std::move(hashes), threads, gamma);
+  }
+
+  // Check if an element is contained in the hashset. May return true for
+  // an element that was not, with probability 2^-bits of Fingerprint.
+  [[nodiscard]] bool Contains(const T &elem) const {
+    uint64_t hash = static_cast<uint64_t>(hash_(elem));
+    size_t index = Find(hash);
+    return index != kNotFound && fingerprints_[index] == FingerprintOf(hash);
+  }
+
+  // Get the size of the hashset
+  [[nodiscard]] size_t Size() const { return size_; }
+
+  // Returns the bits per element of the hash function, without the
+  // fingerprints
+  [[nodiscard]] double IndexBitsPerElement() const {
+    size_t words = bits_.size() + ranks_.size() + fallback_.size();
+    return size_ == 0 ? 0.0
+                      : static_cast<double>(64 * words) /
+                            static_cast<double>(size_);
+  }
+
+  // Returns the number of levels of the hash function
+  [[nodiscard]] size_t Levels() const { return levels_.size(); }
+
+private:
+  static size_t PopCount(uint64_t word) {
+    return static_cast<size_t>(__builtin_popcountll(word));
+  }
+
+  static size_t Position(uint64_t hash, size_t level, size_t size) {
+    return static_cast<size_t>(
+        StaticHashMix(hash + (level + 1) * 0x9E3779B97F4A7C15ull) % size);
+  }
+
+  static Fingerprint FingerprintOf(uint64_t hash) {
+    return static_cast<Fingerprint>(
+        StaticHashMix(hash ^ 0xC2B2AE3D27D4EB4Full) >>
+        (64 - 8 * sizeof(Fingerprint)));
+  }
+
+  // Calls body(thread, begin, end) on |threads| threads, splitting
+  // [0, count) between them
+  template <typename Body>
+  static void ParallelFor(size_t count, size_t threads, Body body) {
+    std::vector<std::thread> workers;
+    size_t chunk = (count + threads - 1) / threads;
+    for (size_t thread = 0; thread < threads; thread++) {
+      size_t begin = std::min(count, thread * chunk);
+      size_t end = std::min(count, begin + chunk);
+      workers.emplace_back(body, thread, begin, end);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Returns the number of set bits of bits_ before |position|
+  size_t Rank(size_t position) const {
+    size_t word = position / 64;
+    size_t rank = static_cast<size_t>(ranks_[word / 8]);
+    for (size_t i = word / 8 * 8; i < word; i++) {
+      rank += PopCount(bits_[i]);
+    }
+    uint64_t below = (uint64_t{1} << (position % 64)) - 1;
+    return rank + PopCount(bits_[word] & below);
+  }
+
+  // Returns the number of the element with |hash|, or kNotFound
+  size_t Find(uint64_t hash) const {
+    for (size_t level = 0; level < levels_.size(); level++) {
+      size_t position =
+          levels_[level].offset + Position(hash, level, levels_[level].size);
+      if ((bits_[position / 64] >> (position % 64)) & 1) {
+        return Rank(position);
+      }
+    }
+    auto it = std::lower_bound(fallback_.begin(), fallback_.end(), hash);
+    if (it == fallback_.end() || *it != hash) {
+      return kNotFound;
+    }
+    size_t ranked = fingerprints_.size() - fallback_.size();
+    return ranked + static_cast<size_t>(it - fallback_.begin());
+  }
+
+  // Builds the levels from |hashes|. Each level moves the hashes it did
+  // not place to the front, so |hashes| keeps them all for the
+  // fingerprints without a copy.
+  void Build(std::vector<uint64_t> hashes, size_t threads, double gamma) {
+    size_t remaining = hashes.size(); // hashes[0, remaining) are unplaced
+    while (remaining > 0 && levels_.size() < kMaxLevels) {
+      size_t level = levels_.size();
+      auto bits = static_cast<size_t>(gamma * static_cast<double>(remaining));
+      size_t words = bits / 64 + 1;
+      size_t size = 64 * words;
+      auto taken = std::make_unique<std::atomic<uint64_t>[]>(words);
+      auto collided = std::make_unique<std::atomic<uint64_t>[]>(words);
+
+      // Set the bit of every element, and note the bits set twice
+      ParallelFor(remaining, threads,
+                  [&](size_t, size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                      size_t position = Position(hashes[i], level, size);
+                      uint64_t bit = uint64_t{1} << (position % 64);
+                      if (taken[position / 64].fetch_or(
+                              bit, std::memory_order_relaxed) &
+                          bit) {
+                        collided[position / 64].fetch_or(
+                            bit, std::memory_order_relaxed);
+                      }
+                    }
+                  });
+
+      // The elements on a collided bit move on to the next level. Each
+      // thread moves them to the front of its range, as {begin, count},
+      // and the fronts are then gathered at the start of |hashes|.
+      std::vector<std::pair<size_t, size_t>> fronts(threads);
+      auto is_collided = [&](uint64_t hash) {
+        size_t position = Position(hash, level, size);
+        uint64_t bit = uint64_t{1} << (position % 64);
+        return (collided[position / 64].load(std::memory_order_relaxed) &
+                bit) != 0;
+      };
+      ParallelFor(remaining, threads,
+                  [&](size_t thread, size_t begin, size_t end) {
+                    uint64_t *first = hashes.data() + begin;
+                    uint64_t *middle = std::partition(
+                        first, hashes.data() + end, is_collided);
+                    fronts[thread] = {begin,
+                                      static_cast<size_t>(middle - first)};
+                  });
+
+      levels_.push_back(Level{64 * bits_.size(), size});
+      for (size_t i = 0; i < words; i++) {
+        bits_.push_back(taken[i].load() & ~collided[i].load());
+      }
+      remaining = 0;
+      for (const auto &[begin, count] : fronts) {
+        uint64_t *first = hashes.data() + begin;
+        std::rotate(hashes.data() + remaining, first, first + count);
+        remaining += count;
+      }
+    }
+
+    // Elements that no level separated have equal hashes
+    fallback_.assign(hashes.data(), hashes.data() + remaining);
+    std::sort(fallback_.begin(), fallback_.end());
+    fallback_.erase(std::unique(fallback_.begin(), fallback_.end()),
+                    fallback_.end());
+    bits_.shrink_to_fit();
+
+    size_t ranked = 0;
+    for (size_t i = 0; i < bits_.size(); i++) {
+      if (i % 8 == 0) {
+        ranks_.push_back(ranked);
+      }
+      ranked += PopCount(bits_[i]);
+    }
+
+    // Every ranked element has a number of its own, so the threads write
+    // to distinct fingerprints
+    fingerprints_.resize(ranked + fallback_.size());
+    ParallelFor(hashes.size(), threads, [&](size_t, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        size_t index = Find(hashes[i]);
+        if (index < ranked) {
+          fingerprints_[index] = FingerprintOf(hashes[i]);
+        }
+      }
+    });
+    for (size_t i = 0; i < fallback_.size(); i++) {
+      fingerprints_[ranked + i] = FingerprintOf(fallback_[i]);
+    }
+  }
+};
+
+// Freeze the elements of |hash_set| into an immutable set, built on
+// |threads| threads, or one per core if 0
+template <typename T, typename Fingerprint = uint8_t>
+HashSetFrozen<T, Fingerprint> Freeze(HashSetBase<T> &hash_set,
+                                     size_t threads = 0) {
+  return HashSetFrozen<T, Fingerprint>(hash_set, threads);
+}
+
+#endif // HASH_SET_FROZEN_H
@@ -0,0 +1,516 @@
+#ifndef HASH_SET_LOCK_FREE_BUCKETS_H
+#define HASH_SET_LOCK_FREE_BUCKETS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "src/hash_set_base.h"
+
+// A hash set whose buckets are Harris-Michael lock-free linked lists, so
+// that Add, Remove and Contains are lock-free.
+//
+// Like HashSetRefinable, the set is an array of buckets that doubles when
+// the average bucket holds more than 4 elements. Here the bigger array is
+// published with a single store, with every bucket marked as not migrated,
+// and each bucket is filled from the old array on first access:
+// - the old bucket is frozen, by setting kFrozen on its head and on every
+//   link in its list, after which no update to it can succeed;
+// - its live nodes that hash to the new bucket are copied into a private
+//   list, which is installed with a CAS on the new bucket's head. Threads
+//   that lose the race free their copy.
+// An operation that runs into a frozen link retries on the newest array.
+// Before publishing a new array, the resizing thread migrates every
+// bucket of the current one, so migration never needs more than one
+// older array.
+//
+// Each list is sorted by hash, and nodes with equal hashes are kept in
+// insertion order. A node is removed by setting kMarked on its next link
+// first, and unlinked afterwards by whichever thread gets there.
+//
+// Memory is reclaimed with epochs. Every operation pins the global epoch
+// in one of kPinSlots slots while it runs. Unlinked nodes are retired
+// with the epoch at which they were retired. Once every bucket of an
+// array has been migrated, its old array is retired the same way, with
+// the frozen lists that only that array still holds. Every kReclaimInterval
+// retirements, one thread advances the epoch and frees whatever was
+// retired before the oldest pinned epoch. A thread stalled inside an
+// operation holds back reclamation, but not the other threads. If all
+// slots are pinned, an operation waits for one to be released.
+template <typename T> class HashSetLockFreeBuckets : public HashSetBase<T> {
+private:
+  // Low bits of a link, the pointer to the next node or a bucket head
+  static constexpr uintptr_t kMarked = 1; // The node owning it is removed
+  static constexpr uintptr_t kFrozen = 2; // The link may no longer change
+  static constexpr uintptr_t kFlags = kMarked | kFrozen;
+  // The head of a bucket that has not been migrated yet. Heads are never
+  // marked, so this value is free.
+  static constexpr uintptr_t kNotMigrated = kMarked | kFrozen;
+
+  // Operations that can be pinned at once
+  static constexpr size_t kPinSlots = 128;
+  // Retirements between attempts to reclaim memory
+  static constexpr size_t kReclaimInterval = 256;
+  // A pin slot that no operation holds. Epochs start at 1.
+  static constexpr uint64_t kUnpinned = 0;
+
+  struct alignas(8) Node {
+    T elem;                      // The element
+    size_t hash;                 // The full hash of the element
+    std::atomic<uintptr_t> next; // The next node, plus flags
+    Node *retired_next;          // The next node in the retired stack
+    uint64_t retired_epoch;      // The epoch when it was retired
+  };
+
+  struct Table {
+    size_t capacity;                                   // Number of buckets
+    std::unique_ptr<std::atomic<uintptr_t>[]> buckets; // Heads of the lists
+    std::atomic<Table *> old;    // Array to migrate, until fully migrated
+    Table *retired_next;         // The next array in the retired stack
+    uint64_t retired_epoch;      // The epoch when it was retired
+  };
+
+  // The epoch an operation in flight pinned, on its own cache line
+  struct alignas(64) PinSlot {
+    std::atomic<uint64_t> epoch{kUnpinned};
+  };
+
+  // Holds a pin slot for the duration of an operation
+  class Pin {
+  private:
+    std::atomic<uint64_t> *slot_;
+
+  public:
+    explicit Pin(HashSetLockFreeBuckets &set) : slot_(set.PinEpoch()) {}
+    ~Pin() { slot_->store(kUnpinned); }
+
+    Pin(const Pin &) = delete;
+    Pin &operator=(const Pin &) = delete;
+  };
+
+  // Result of Find
+  enum class Position {
+    kFound,    // The element is in the list, at the current node
+    kNotFound, // The element is not in the list
+    kFrozen,   // The list was frozen, retry on the newest array
+  };
+
+  std::atomic<Table *> table_;           // The newest bucket array
+  std::atomic<size_t> size_;             // The number of elements
+  std::atomic<bool> resizing_;           // Set while a thread resizes
+  std::atomic<uint64_t> epoch_{1};       // The global epoch
+  std::unique_ptr<PinSlot[]> pins_;      // Epochs pinned by operations
+  std::atomic<Node *> retired_;          // Unlinked nodes, not freed yet
+  std::atomic<Table *> retired_tables_;  // Replaced arrays, not freed yet
+  std::atomic<size_t> retirements_{0};   // Retirements so far
+  std::atomic<bool> reclaiming_{false};  // Set while a thread reclaims
+
+public:
+  // Initialize the capacity and initialise the table
+  explicit HashSetLockFreeBuckets(size_t initial_capacity)
+      : table_(NewTable(initial_capacity, nullptr, 0)), size_(0),
+        resizing_(false), pins_(new PinSlot[kPinSlots]), retired_(nullptr),
+        retired_tables_(nullptr) {}
+
+  ~HashSetLockFreeBuckets() override {
+    Table *table = table_.load();
+    while (table != nullptr) {
+      Table *old = table->old.load();
+      DeleteTable(table);
+      table = old;
+    }
+    FreeRetired(UINT64_MAX);
+  }
+
+  HashSetLockFreeBuckets(const HashSetLockFreeBuckets &) = delete;
+  HashSetLockFreeBuckets &operator=(const HashSetLockFreeBuckets &) = delete;
+
+  // Add an element to the hash set
+  bool Add(T elem) final {
+    size_t hash = std::hash<T>()(elem);
+    Pin pin(*this);
+    Node *node = nullptr;
+    while (true) {
+      Table *table = table_.load();
+      std::atomic<uintptr_t> *prev = nullptr;
+      Node *curr = nullptr;
+      Position position = Find(Head(table, hash), hash, elem, prev, curr);
+      if (position == Position::kFrozen) {
+        continue;
+      }
+      if (position == Position::kFound) {
+        delete node;
+        return false;
+      }
+
+      // Link a new node in front of the first node with a bigger hash
+      if (node == nullptr) {
+        node = new Node{elem, hash, {0}, nullptr, 0};
+      }
+      node->next.store(ToLink(curr));
+      uintptr_t expected = ToLink(curr);
+      if (prev->compare_exchange_strong(expected, ToLink(node))) {
+        // If the average bucket size is 4, increase size.
+        if (size_.fetch_add(1) + 1 > 4 * table->capacity) {
+          resize(table);
+        }
+        return true;
+      }
+    }
+  }
+
+  // Remove an element from the hashset
+  bool Remove(T elem) final {
+    size_t hash = std::hash<T>()(elem);
+    Pin pin(*this);
+    while (true) {
+      Table *table = table_.load();
+      std::atomic<uintptr_t> *prev = nullptr;
+      Node *curr = nullptr;
+      Position position = Find(Head(table, hash), hash, elem, prev, curr);
+      if (position == Position::kFrozen) {
+        continue;
+      }
+      if (position == Position::kNotFound) {
+        return false;
+      }
+
+      // Marking the node removes it; unlinking it can be left to others
+      uintptr_t next = curr->next.load();
+      if ((next & kFlags) != 0 ||
+          !curr->next.compare_exchange_strong(next, next | kMarked)) {
+        continue;
+      }
+      size_.fetch_sub(1);
+      uintptr_t expected = ToLink(curr);
+      if (prev->compare_exchange_strong(expected, next)) {
+        Retire(curr);
+      }
+      return true;
+    }
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] bool Contains(T elem) final {
+    size_t hash = std::hash<T>()(elem);
+    Pin pin(*this);
+    while (true) {
+      Table *table = table_.load();
+      std::atomic<uintptr_t> *prev = nullptr;
+      Node *curr = nullptr;
+      Position position = Find(Head(table, hash), hash, elem, prev, curr);
+      if (position != Position::kFrozen) {
+        return position == Position::kFound;
+      }
+    }
+  }
+
+  // Get the size of the hashset
+  [[nodiscard]] size_t Size() const final { return size_.load(); }
+
+  // Call |f| on every element of the newest array. Lists frozen by a
+  // concurrent resize are still walked to their end, so elements added
+  // to the next array meanwhile are not visited.
+  void ForEach(const std::function<void(const T &)> &f) final {
+    Pin pin(*this);
+    Table *table = table_.load();
+    for (size_t i = 0; i < table->capacity; i++) {
+      for (Node *node = ToNode(Head(table, i).load()); node != nullptr;
+           node = ToNode(node->next.load())) {
+        if ((node->next.load() & kMarked) == 0) {
+          f(node->elem);
+        }
+      }
+    }
+  }
+
+private:
+  static Node *ToNode(uintptr_t link) {
+    return reinterpret_cast<Node *>(link & ~kFlags);
+  }
+
+  static uintptr_t ToLink(Node *node) {
+    return reinterpret_cast<uintptr_t>(node);
+  }
+
+  static Table *NewTable(size_t capacity, Table *old, uintptr_t head) {
+    auto *table = new Table{
+        capacity, std::make_unique<std::atomic<uintptr_t>[]>(capacity), {old},
+        nullptr, 0};
+    for (size_t i = 0; i < capacity; i++) {
+      table->buckets[i].store(head);
+    }
+    return table;
+  }
+
+  // Returns the head of the bucket of |hash| in |table|, migrating it
+  // first if needed
+  std::atomic<uintptr_t> &Head(Table *table, size_t hash) {
+    size_t index = hash % table->capacity;
+    if (table->buckets[index].load() == kNotMigrated) {
+      Migrate(table, index);
+    }
+    return table->buckets[index];
+  }
+
+  // Looks for |elem| in the list starting at |head|, unlinking removed
+  // nodes on the way. On kFound, |curr| is the node of |elem|; on
+  // kNotFound, it is the first node with a bigger hash, or nullptr. In both
+  // cases, |prev| is the unmarked link that pointed to |curr|.
+  Position Find(std::atomic<uintptr_t> &head, size_t hash, const T &elem,
+                std::atomic<uintptr_t> *&prev, Node *&curr) {
+  retry:
+    prev = &head;
+    uintptr_t link = prev->load();
+    while (true) {
+      if ((link & kFrozen) != 0) {
+        return Position::kFrozen;
+      }
+      curr = ToNode(link);
+      if (curr == nullptr) {
+        return Position::kNotFound;
+      }
+      uintptr_t next = curr->next.load();
+      // If |prev| changed, |curr| may have been unlinked already
+      if (prev->load() != link) {
+        goto retry;
+      }
+      if ((next & kFrozen) != 0) {
+        return Position::kFrozen;
+      }
+
+      if ((next & kMarked) != 0) {
+        // |curr| is removed, unlink it
+        uintptr_t expected = link;
+        if (!prev->compare_exchange_strong(expected, next & ~kMarked)) {
+          goto retry;
+        }
+        Retire(curr);
+        link = next & ~kMarked;
+        continue;
+      }
+
+      if (curr->hash > hash) {
+        return Position::kNotFound;
+      }
+      if (curr->hash == hash && curr->elem == elem) {
+        return Position::kFound;
+      }
+      prev = &curr->next;
+      link = next;
+    }
+  }
+
+  // Fills bucket |index| of |table| from the array it replaced
+  void Migrate(Table *table, size_t index) {
+    Table *old = table->old.load();
+    if (old == nullptr) {
+      // The resizing thread migrated every bucket, and retired |old|
+      return;
+    }
+    std::atomic<uintptr_t> &old_head = old->buckets[index % old->capacity];
+    Freeze(old_head);
+
+    // Copy the live nodes that now belong to |index|, in order
+    Node *first = nullptr;
+    Node *last = nullptr;
+    for (Node *node = ToNode(old_head.load()); node != nullptr;
+         node = ToNode(node->next.load())) {
+      if ((node->next.load() & kMarked) != 0 ||
+          node->hash % table->capacity != index) {
+        continue;
+      }
+      auto *copy = new Node{node->elem, node->hash, {0}, nullptr, 0};
+      if (last == nullptr) {
+        first = copy;
+      } else {
+        last->next.store(ToLink(copy));
+      }
+      last = copy;
+    }
+
+    uintptr_t expected = kNotMigrated;
+    if (!table->buckets[index].compare_exchange_strong(expected,
+                                                       ToLink(first))) {
+      // Another thread migrated the bucket first
+      while (first != nullptr) {
+        Node *next = ToNode(first->next.load());
+        delete first;
+        first = next;
+      }
+    }
+  }
+
+  // Sets kFrozen on |head| and on every link of its list
+  static void Freeze(std::atomic<uintptr_t> &head) {
+    std::atomic<uintptr_t> *link = &head;
+    while (link != nullptr) {
+      uintptr_t value = link->load();
+      while ((value & kFrozen) == 0 &&
+             !link->compare_exchange_weak(value, value | kFrozen)) {
+      }
+      Node *next = ToNode(value);
+      link = next == nullptr ? nullptr : &next->next;
+    }
+  }
+
+  // Pins the current epoch in a free slot, and returns the slot
+  std::atomic<uint64_t> *PinEpoch() {
+    // Threads start at different slots, so they rarely compete for one
+    thread_local size_t hint =
+        std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (size_t i = hint;; i++) {
+      std::atomic<uint64_t> &slot = pins_[i % kPinSlots].epoch;
+      uint64_t expected = kUnpinned;
+      uint64_t epoch = epoch_.load();
+      if (slot.load() != kUnpinned ||
+          !slot.compare_exchange_strong(expected, epoch)) {
+        if ((i + 1 - hint) % kPinSlots == 0) {
+          std::this_thread::yield();
+        }
+        continue;
+      }
+      // The epoch may have moved on before the slot showed it, and memory
+      // retired before the new epoch may be freed already
+      uint64_t current = epoch_.load();
+      while (current != epoch) {
+        epoch = current;
+        slot.store(epoch);
+        current = epoch_.load();
+      }
+      hint = i;
+      return &slot;
+    }
+  }
+
+  // Pushes an unlinked node on the retired stack
+  void Retire(Node *node) {
+    node->retired_epoch = epoch_.load();
+    Node *top = retired_.load();
+    do {
+      node->retired_next = top;
+    } while (!retired_.compare_exchange_weak(top, node));
+    OnRetire();
+  }
+
+  // Pushes a replaced array, with its frozen lists, on the retired stack
+  void Retire(Table *table) {
+    table->retired_epoch = epoch_.load();
+    Table *top = retired_tables_.load();
+    do {
+      table->retired_next = top;
+    } while (!retired_tables_.compare_exchange_weak(top, table));
+    OnRetire();
+  }
+
+  // Reclaims memory every kReclaimInterval retirements
+  void OnRetire() {
+    if ((retirements_.fetch_add(1) + 1) % kReclaimInterval != 0 ||
+        reclaiming_.exchange(true)) {
+      return;
+    }
+    // Operations pinned from now on cannot reach what was retired so far
+    epoch_.fetch_add(1);
+    uint64_t oldest = epoch_.load();
+    for (size_t i = 0; i < kPinSlots; i++) {
+      uint64_t pinned = pins_[i].epoch.load();
+      if (pinned != kUnpinned) {
+        oldest = std::min(oldest, pinned);
+      }
+    }
+    FreeRetired(oldest);
+    reclaiming_.store(false);
+  }
+
+  // Frees what was retired before the epoch |oldest|, and keeps the rest.
+  // Only one thread frees at a time.
+  void FreeRetired(uint64_t oldest) {
+    Node *kept = nullptr;
+    Node *node = retired_.exchange(nullptr);
+    while (node != nullptr) {
+      Node *next = node->retired_next;
+      if (node->retired_epoch < oldest) {
+        delete node;
+      } else {
+        node->retired_next = kept;
+        kept = node;
+      }
+      node = next;
+    }
+    while (kept != nullptr) {
+      Node *next = kept->retired_next;
+      Node *top = retired_.load();
+      do {
+        kept->retired_next = top;
+      } while (!retired_.compare_exchange_weak(top, kept));
+      kept = next;
+    }
+
+    Table *kept_tables = nullptr;
+    Table *table = retired_tables_.exchange(nullptr);
+    while (table != nullptr) {
+      Table *next = table->retired_next;
+      if (table->retired_epoch < oldest) {
+        DeleteTable(table);
+      } else {
+        table->retired_next = kept_tables;
+        kept_tables = table;
+      }
+      table = next;
+    }
+    while (kept_tables != nullptr) {
+      Table *next = kept_tables->retired_next;
+      Table *top = retired_tables_.load();
+      do {
+        kept_tables->retired_next = top;
+      } while (!retired_tables_.compare_exchange_weak(top, kept_tables));
+      kept_tables = next;
+    }
+  }
+
+  // Frees |table| and the nodes of its lists
+  static void DeleteTable(Table *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+      uintptr_t link = table->buckets[i].load();
+      if (link == kNotMigrated) {
+        continue;
+      }
+      Node *node = ToNode(link);
+      while (node != nullptr) {
+        Node *next = ToNode(node->next.load());
+        delete node;
+        node = next;
+      }
+    }
+    delete table;
+  }
+
+  // Double the size of the hashset, if |table| is still the newest array
+  void resize(Table *table) {
+    // Only one thread resizes at a time; the others carry on
+    if (resizing_.exchange(true)) {
+      return;
+    }
+    if (table_.load() == table) {
+      // Finish migrating |table|, so that it no longer needs its old array
+      for (size_t i = 0; i < table->capacity; i++) {
+        if (table->buckets[i].load() == kNotMigrated) {
+          Migrate(table, i);
+        }
+      }
+      table_.store(NewTable(table->capacity * 2, table, kNotMigrated));
+      Table *old = table->old.exchange(nullptr);
+      resizing_.store(false);
+      if (old != nullptr) {
+        Retire(old);
+      }
+      return;
+    }
+    resizing_.store(false);
+  }
+};
+
+#endif // HASH_SET_LOCK_FREE_BUCKETS_H
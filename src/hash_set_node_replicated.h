@@ -0,0 +1,345 @@
+#ifndef HASH_SET_NODE_REPLICATED_H
+#define HASH_SET_NODE_REPLICATED_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_sequential.h"
+#include "src/numa_topology.h"
+
+// Returns a new id for a NodeReplicated set, to key per-thread caches
+inline uint64_t NextNodeReplicatedSetId() {
+  static std::atomic<uint64_t> next_id{1};
+  return next_id.fetch_add(1);
+}
+
+// Makes a sequential hash set concurrent by node replication: each NUMA
+// node has its own replica of the set, and all changes go through one
+// shared log of operations.
+//
+// A thread that changes the set posts the operation in its slot on its
+// node, and whichever thread gets the node's combiner lock appends all
+// posted operations of the node to the log as one batch, then applies
+// the log up to the end of that batch to the node's replica. Each node
+// thus appends once per batch, and applies the batches of the other
+// nodes on its own replica, in log order.
+//
+// Contains, Size and ForEach read the local replica under a shared lock,
+// after applying any operation that has completed on another node, so
+// lookups never touch another node's memory. The replica and its slots
+// are allocated by a thread pinned to the node, and only threads of the
+// node change the replica afterwards.
+//
+// The log is a ring of |log_size| entries. An entry can only be reused
+// once every replica has applied it, so a combiner that finds the log
+// full applies the lagging replicas itself.
+//
+// A thread is mapped to the node of the CPU it first uses the set on.
+// With |num_nodes| set, threads are spread round robin over that many
+// replicas instead, without pinning, e.g. to test on a single node.
+template <typename Inner>
+class NodeReplicated
+    : public HashSetBase<typename HashSetElement<Inner>::Type> {
+private:
+  using T = typename HashSetElement<Inner>::Type;
+
+  // Threads per node with a slot of their own. Other threads of the node
+  // combine their operations alone.
+  static constexpr size_t kSlotsPerNode = 64;
+
+  enum class Operation : uint8_t { kAdd, kRemove };
+
+  enum SlotState : uint32_t { kIdle = 0, kPending = 1, kDone = 2 };
+
+  struct LogEntry {
+    std::atomic<uint64_t> filled{0}; // Its log index + 1 once written
+    T elem{};                        // The element to add or remove
+    Operation operation = Operation::kAdd;
+  };
+
+  // An operation posted to the node's combiner
+  struct alignas(64) Slot {
+    std::atomic<uint32_t> state{kIdle}; // A SlotState
+    T elem{};                           // Written before kPending
+    Operation operation = Operation::kAdd;
+    bool result = false; // Written before kDone
+  };
+
+  struct Node {
+    std::unique_ptr<Inner> replica;               // This node's copy
+    std::unique_ptr<Slot[]> slots;                // Posted operations
+    std::atomic<size_t> slots_used{0};            // Slots given to threads
+    std::vector<Slot *> batch;                    // Under combiner
+    alignas(64) std::mutex combiner;              // Held to apply the log
+    std::shared_mutex replica_mutex;              // Shared by readers
+    alignas(64) std::atomic<uint64_t> applied{0}; // Log entries applied
+  };
+
+  struct ThreadNode {
+    std::thread::id owner; // The registered thread
+    size_t node;           // Its node
+    Slot *slot;            // Its slot, or nullptr if the node ran out
+  };
+
+  struct ThreadCache {
+    uint64_t set_id;
+    const ThreadNode *thread;
+  };
+
+  NumaTopology topology_;                          // Maps CPUs to nodes
+  bool simulated_;                                 // Round robin nodes
+  std::vector<std::unique_ptr<Node>> nodes_;       // One per node
+  std::unique_ptr<LogEntry[]> log_;                // The operation log
+  size_t log_mask_;                                // Log size - 1
+  alignas(64) std::atomic<uint64_t> log_tail_{0};  // Next entry to reserve
+  alignas(64) std::atomic<uint64_t> completed_{0}; // Entries done somewhere
+  uint64_t id_;                                    // Keys the thread cache
+  mutable std::mutex threads_mutex_;               // Protects threads_
+  mutable std::vector<std::unique_ptr<ThreadNode>> threads_;
+
+public:
+  // Build one replica of |initial_capacity| per node, and a log of
+  // |log_size| entries, rounded up to a power of two
+  explicit NodeReplicated(size_t initial_capacity, size_t num_nodes = 0,
+                          size_t log_size = 1 << 16)
+      : simulated_(num_nodes != 0), log_mask_(0),
+        id_(NextNodeReplicatedSetId()) {
+    size_t count = simulated_ ? num_nodes : topology_.Nodes();
+    size_t size = 1;
+    while (size < std::max(log_size, 2 * kSlotsPerNode)) {
+      size *= 2;
+    }
+    log_ = std::make_unique<LogEntry[]>(size);
+    log_mask_ = size - 1;
+    nodes_.resize(count);
+    for (size_t n = 0; n < count; n++) {
+      // Allocate on the node, relying on first-touch placement
+      std::thread([this, n, initial_capacity] {
+        if (!simulated_) {
+          topology_.PinToNode(n);
+        }
+        nodes_[n] = std::make_unique<Node>();
+        nodes_[n]->replica = std::make_unique<Inner>(initial_capacity);
+        nodes_[n]->slots = std::make_unique<Slot[]>(kSlotsPerNode);
+      }).join();
+    }
+  }
+
+  // Add an element to the hash set
+  bool Add(T elem) final { return Execute(Operation::kAdd, elem); }
+
+  // Remove an element from the hash set
+  bool Remove(T elem) final { return Execute(Operation::kRemove, elem); }
+
+  // Check if an element is contained in the hashset, in the local replica
+  [[nodiscard]] bool Contains(T elem) final {
+    Node &node = SyncedNode();
+    std::shared_lock<std::shared_mutex> lock(node.replica_mutex);
+    return node.replica->Contains(elem);
+  }
+
+  // Get the size of the hashset, from the local replica
+  [[nodiscard]] size_t Size() const final {
+    Node &node = SyncedNode();
+    std::shared_lock<std::shared_mutex> lock(node.replica_mutex);
+    return node.replica->Size();
+  }
+
+  // Call |f| on every element of the local replica
+  void ForEach(const std::function<void(const T &)> &f) final {
+    Node &node = SyncedNode();
+    std::shared_lock<std::shared_mutex> lock(node.replica_mutex);
+    node.replica->ForEach(f);
+  }
+
+  // Returns the number of replicas
+  [[nodiscard]] size_t Replicas() const { return nodes_.size(); }
+
+  // Returns the number of operations appended to the log
+  [[nodiscard]] uint64_t LogLength() const { return log_tail_.load(); }
+
+private:
+  // Posts an operation to the calling thread's node, and waits until a
+  // combiner, maybe this thread, has applied it
+  bool Execute(Operation operation, const T &elem) {
+    const ThreadNode &thread = CurrentThread();
+    Node &node = *nodes_[thread.node];
+    if (thread.slot == nullptr) {
+      Slot alone;
+      alone.elem = elem;
+      alone.operation = operation;
+      std::scoped_lock<std::mutex> lock(node.combiner);
+      Combine(node, &alone);
+      return alone.result;
+    }
+
+    Slot &slot = *thread.slot;
+    slot.elem = elem;
+    slot.operation = operation;
+    slot.state.store(kPending, std::memory_order_release);
+    while (slot.state.load(std::memory_order_acquire) != kDone) {
+      if (node.combiner.try_lock()) {
+        Combine(node, nullptr);
+        node.combiner.unlock();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    slot.state.store(kIdle, std::memory_order_relaxed);
+    return slot.result;
+  }
+
+  // Appends the posted operations of |node|, and |alone| if not null, to
+  // the log, and applies them. The combiner lock must be held.
+  void Combine(Node &node, Slot *alone) {
+    node.batch.clear();
+    size_t used = std::min(node.slots_used.load(), kSlotsPerNode);
+    for (size_t i = 0; i < used; i++) {
+      if (node.slots[i].state.load(std::memory_order_acquire) == kPending) {
+        node.batch.push_back(&node.slots[i]);
+      }
+    }
+    if (alone != nullptr) {
+      node.batch.push_back(alone);
+    }
+    if (node.batch.empty()) {
+      return;
+    }
+
+    uint64_t start = Reserve(node, node.batch.size());
+    for (size_t i = 0; i < node.batch.size(); i++) {
+      LogEntry &entry = log_[(start + i) & log_mask_];
+      entry.elem = node.batch[i]->elem;
+      entry.operation = node.batch[i]->operation;
+      entry.filled.store(start + i + 1, std::memory_order_release);
+    }
+    uint64_t end = start + node.batch.size();
+    Apply(node, end, start);
+
+    uint64_t completed = completed_.load();
+    while (completed < end &&
+           !completed_.compare_exchange_weak(completed, end)) {
+    }
+    for (Slot *slot : node.batch) {
+      slot->state.store(kDone, std::memory_order_release);
+    }
+  }
+
+  // Reserves |count| log entries for |node|, and returns the first
+  uint64_t Reserve(Node &node, size_t count) {
+    while (true) {
+      uint64_t tail = log_tail_.load();
+      if (tail + count - OldestApplied() <= log_mask_ + 1) {
+        if (log_tail_.compare_exchange_weak(tail, tail + count)) {
+          return tail;
+        }
+        continue;
+      }
+      // The log is full: catch up this replica, then help the others
+      Apply(node, tail, tail);
+      for (auto &other : nodes_) {
+        if (other.get() != &node && other->applied.load() < tail &&
+            other->combiner.try_lock()) {
+          Apply(*other, tail, tail);
+          other->combiner.unlock();
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // Applies the log to the replica of |node| up to |end|, storing the
+  // results of entries from |batch_start| in node.batch. The combiner
+  // lock of |node| must be held. Const, like the readers that call it,
+  // since it only brings the replica up to date with the log.
+  void Apply(Node &node, uint64_t end, uint64_t batch_start) const {
+    uint64_t index = node.applied.load(std::memory_order_relaxed);
+    if (index >= end) {
+      return;
+    }
+    std::unique_lock<std::shared_mutex> lock(node.replica_mutex);
+    for (; index < end; index++) {
+      LogEntry &entry = log_[index & log_mask_];
+      // Reserved entries are written right after, without blocking
+      while (entry.filled.load(std::memory_order_acquire) != index + 1) {
+        std::this_thread::yield();
+      }
+      bool result = entry.operation == Operation::kAdd
+                        ? node.replica->Add(entry.elem)
+                        : node.replica->Remove(entry.elem);
+      if (index >= batch_start && index - batch_start < node.batch.size()) {
+        node.batch[index - batch_start]->result = result;
+      }
+    }
+    node.applied.store(end, std::memory_order_release);
+  }
+
+  uint64_t OldestApplied() const {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto &node : nodes_) {
+      oldest = std::min(oldest, node->applied.load());
+    }
+    return oldest;
+  }
+
+  // Returns the calling thread's node, once it has applied every
+  // operation that completed before
+  Node &SyncedNode() const {
+    Node &node = *nodes_[CurrentThread().node];
+    uint64_t completed = completed_.load(std::memory_order_acquire);
+    while (node.applied.load(std::memory_order_acquire) < completed) {
+      if (node.combiner.try_lock()) {
+        // Only entries of batches that are already written, since a
+        // batch completes after it is written
+        Apply(node, completed, completed);
+        node.combiner.unlock();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    return node;
+  }
+
+  // Returns the calling thread's node and slot, registering it on first
+  // use
+  const ThreadNode &CurrentThread() const {
+    thread_local ThreadCache cache{0, nullptr};
+    if (cache.set_id == id_) {
+      return *cache.thread;
+    }
+
+    std::thread::id this_thread = std::this_thread::get_id();
+    std::scoped_lock<std::mutex> lock(threads_mutex_);
+    auto it = std::find_if(
+        threads_.begin(), threads_.end(),
+        [&](const auto &thread) { return thread->owner == this_thread; });
+    if (it == threads_.end()) {
+      size_t node = simulated_ ? threads_.size() % nodes_.size()
+                               : topology_.CurrentNode() % nodes_.size();
+      size_t index = nodes_[node]->slots_used.fetch_add(1);
+      Slot *slot =
+          index < kSlotsPerNode ? &nodes_[node]->slots[index] : nullptr;
+      threads_.push_back(
+          std::make_unique<ThreadNode>(ThreadNode{this_thread, node, slot}));
+      it = threads_.end() - 1;
+    }
+    cache = ThreadCache{id_, it->get()};
+    return **it;
+  }
+};
+
+// Node replication of HashSetSequential, for the demos and the registry
+template <typename T>
+using HashSetNodeReplicated = NodeReplicated<HashSetSequential<T>>;
+
+#endif // HASH_SET_NODE_REPLICATED_H
@@ -0,0 +1,192 @@
+#ifndef HASH_SET_POLICIES_H
+#define HASH_SET_POLICIES_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// Policies for the hash sets that take them as template parameters, next
+// to the Bucket types of hash_set_buckets.h and the Hash. They are chosen
+// at compile time, so that a policy which is not used costs nothing.
+
+// Lock policies: any type with lock(), try_lock() and unlock() can be used,
+// such as std::mutex, which is the default.
+
+// A test-and-test-and-set spinlock, for stripes that are held for a few
+// instructions. Waiting threads yield instead of spinning hot, since a
+// lock holder that was preempted cannot release the lock until it runs
+// again.
+class SpinLock {
+private:
+  std::atomic<bool> locked_ = false; // True while a thread holds the lock
+
+public:
+  void lock() {
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+      while (locked_.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  bool try_lock() {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+  }
+
+  void unlock() { locked_.store(false, std::memory_order_release); }
+};
+
+// The settings shared by every DeschedulingLock in the process
+class Descheduling {
+public:
+  // Makes lock holders sleep for |length| after a fraction |probability|
+  // of the acquisitions. A probability of 0 turns it off.
+  static void Configure(double probability, std::chrono::microseconds length) {
+    Threshold().store(static_cast<uint_fast32_t>(
+        probability * static_cast<double>(std::minstd_rand::max())));
+    Length().store(length.count());
+  }
+
+  // Returns the number of times a lock holder slept
+  static uint64_t Sleeps() { return SleepCount().load(); }
+
+  // Sleeps with the configured probability
+  static void MaybeSleep() {
+    uint_fast32_t threshold = Threshold().load(std::memory_order_relaxed);
+    if (threshold == 0) {
+      return;
+    }
+    // Cheap, and seeded differently in each thread
+    thread_local std::minstd_rand random(
+        static_cast<std::minstd_rand::result_type>(
+            std::hash<std::thread::id>()(std::this_thread::get_id())));
+    if (random() < threshold) {
+      SleepCount().fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(Length().load()));
+    }
+  }
+
+private:
+  static std::atomic<uint_fast32_t> &Threshold() {
+    static std::atomic<uint_fast32_t> threshold{0};
+    return threshold;
+  }
+
+  static std::atomic<int64_t> &Length() {
+    static std::atomic<int64_t> length{0};
+    return length;
+  }
+
+  static std::atomic<uint64_t> &SleepCount() {
+    static std::atomic<uint64_t> sleeps{0};
+    return sleeps;
+  }
+};
+
+// A Mutex whose holder may sleep right after acquiring it, as set by
+// Descheduling::Configure, as if preempted inside the critical section.
+// Containers running with CPU quotas are throttled at arbitrary points,
+// lock holders included, and then every thread waiting for the lock
+// waits for the whole throttling period too. While turned off it costs a
+// relaxed load per acquisition.
+template <typename Mutex = std::mutex> class DeschedulingLock {
+private:
+  Mutex mutex_; // The lock itself
+
+public:
+  void lock() {
+    mutex_.lock();
+    Descheduling::MaybeSleep();
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    Descheduling::MaybeSleep();
+    return true;
+  }
+
+  void unlock() { mutex_.unlock(); }
+};
+
+// Load factor policies decide when a set doubles its capacity.
+
+// Resize once the set holds more than kNumerator / kDenominator elements
+// per bucket on average
+template <size_t kNumerator, size_t kDenominator = 1> struct LoadFactor {
+  static_assert(kNumerator > 0 && kDenominator > 0,
+                "The load factor must be positive");
+
+  static bool Exceeded(size_t size, size_t capacity) {
+    return size * kDenominator > kNumerator * capacity;
+  }
+};
+
+// The load factor the sets have always used
+using DefaultLoadFactor = LoadFactor<4>;
+
+// Stats policies are told about every operation and its result.
+
+// Counts nothing; every call compiles away
+struct NoStats {
+  void OnAdd(bool /*added*/) {}
+  void OnRemove(bool /*removed*/) {}
+  void OnContains(bool /*found*/) {}
+  void OnResize() {}
+};
+
+// Counts the operations and how many of them succeeded. The counters are
+// shared by all threads, so every operation writes to a contended cache
+// line: use this to understand a workload, not in production.
+class CountingStats {
+private:
+  std::atomic<size_t> adds_ = 0;    // Calls to Add
+  std::atomic<size_t> added_ = 0;   // Adds of absent elements
+  std::atomic<size_t> removes_ = 0; // Calls to Remove
+  std::atomic<size_t> removed_ = 0; // Removes of present elements
+  std::atomic<size_t> lookups_ = 0; // Calls to Contains
+  std::atomic<size_t> found_ = 0;   // Lookups of present elements
+  std::atomic<size_t> resizes_ = 0; // Times the capacity was doubled
+
+public:
+  void OnAdd(bool added) {
+    adds_.fetch_add(1, std::memory_order_relaxed);
+    if (added) {
+      added_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void OnRemove(bool removed) {
+    removes_.fetch_add(1, std::memory_order_relaxed);
+    if (removed) {
+      removed_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void OnContains(bool found) {
+    lookups_.fetch_add(1, std::memory_order_relaxed);
+    if (found) {
+      found_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void OnResize() { resizes_.fetch_add(1, std::memory_order_relaxed); }
+
+  [[nodiscard]] size_t Adds() const { return adds_.load(); }
+  [[nodiscard]] size_t Added() const { return added_.load(); }
+  [[nodiscard]] size_t Removes() const { return removes_.load(); }
+  [[nodiscard]] size_t Removed() const { return removed_.load(); }
+  [[nodiscard]] size_t Lookups() const { return lookups_.load(); }
+  [[nodiscard]] size_t Found() const { return found_.load(); }
+  [[nodiscard]] size_t Resizes() const { return resizes_.load(); }
+};
+
+#endif // HASH_SET_POLICIES_H
@@ -0,0 +1,289 @@
+#ifndef HASH_SET_RECORDING_H
+#define HASH_SET_RECORDING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/trace.h"
+
+// Returns a new id for a RecordingHashSet, never reused in a process
+inline uint64_t NextRecordingSetId() {
+  static std::atomic<uint64_t> next_id{1};
+  return next_id.fetch_add(1);
+}
+
+// The rings of a RecordingHashSet that no thread holds. Threads only keep
+// a weak_ptr to it, so one exiting after the set is gone skips it.
+struct RecordingRingPool {
+  std::mutex mutex;         // Protects free
+  std::vector<size_t> free; // Indices of the rings no thread holds
+};
+
+// The rings the calling thread holds, one per RecordingHashSet it used.
+// They are returned to their pools when the thread exits, so that thread
+// pools recreated over the life of a service do not use up the rings.
+class RecordingRingLeases {
+private:
+  struct Lease {
+    uint64_t set_id;                       // The set the ring belongs to
+    std::weak_ptr<RecordingRingPool> pool; // Expired once the set is gone
+    size_t ring;                           // Index of the held ring
+  };
+
+  std::vector<Lease> leases_; // At most one per set
+
+public:
+  ~RecordingRingLeases() {
+    for (const Lease &lease : leases_) {
+      if (auto pool = lease.pool.lock()) {
+        std::scoped_lock<std::mutex> lock(pool->mutex);
+        pool->free.push_back(lease.ring);
+      }
+    }
+  }
+
+  // Returns the ring the calling thread holds for the set |set_id|, taking
+  // one from |pool| on first use, or |none| if all are taken
+  static size_t RingOf(uint64_t set_id,
+                       const std::shared_ptr<RecordingRingPool> &pool,
+                       size_t none) {
+    thread_local RecordingRingLeases leases;
+    for (const Lease &lease : leases.leases_) {
+      if (lease.set_id == set_id) {
+        return lease.ring;
+      }
+    }
+    size_t ring = none;
+    {
+      std::scoped_lock<std::mutex> lock(pool->mutex);
+      if (!pool->free.empty()) {
+        ring = pool->free.back();
+        pool->free.pop_back();
+      }
+    }
+    if (ring != none) {
+      // Leases of sets destroyed since are dropped along the way
+      auto &all = leases.leases_;
+      all.erase(std::remove_if(all.begin(), all.end(),
+                               [](const Lease &lease) {
+                                 return lease.pool.expired();
+                               }),
+                all.end());
+      all.push_back(Lease{set_id, pool, ring});
+    }
+    return ring;
+  }
+};
+
+// A decorator that records every Add, Remove and Contains on the wrapped
+// hash set into a trace file, for replaying with bench_replay.
+//
+// Recording must not slow down the workload it captures, so the calling
+// thread only takes a timestamp and appends a record to its own ring
+// buffer, without locks or allocation. A background thread drains the
+// rings into the trace file. When a ring is full, or more than
+// |max_threads| live threads use the set, the record is dropped and
+// counted in Dropped() instead of blocking the caller. A thread gives its
+// ring back when it exits, and the next new thread continues it.
+//
+// Integral keys are recorded as-is, and other keys by their std::hash.
+template <typename Inner>
+class RecordingHashSet
+    : public HashSetBase<typename HashSetElement<Inner>::Type> {
+private:
+  using T = typename HashSetElement<Inner>::Type;
+  using Clock = std::chrono::steady_clock;
+
+  // A single-producer single-consumer ring of records. The producer is the
+  // thread holding the ring, and the consumer is the flush thread.
+  // Head and tail live on their own cache lines so that the two sides do
+  // not invalidate each other's line on every record.
+  struct Ring {
+    std::atomic<trace::Record *> records{nullptr}; // Allocated on first use
+    alignas(64) std::atomic<uint64_t> head{0};     // Next record to write
+    uint64_t cached_tail = 0;                      // Producer's view of tail
+    alignas(64) std::atomic<uint64_t> tail{0};     // Next record to flush
+  };
+
+  std::unique_ptr<Inner> inner_;            // The recorded hash set
+  std::unique_ptr<Ring[]> rings_;           // One ring per live thread
+  size_t max_threads_;                      // The number of rings
+  uint64_t id_;                             // Identifies the set in leases
+  std::shared_ptr<RecordingRingPool> pool_; // The rings no thread holds
+  size_t ring_capacity_;                    // Records per ring, a power of two
+  Clock::time_point start_;                 // Time zero of the trace
+  std::atomic<uint64_t> dropped_{0};        // Records that could not be queued
+  trace::Writer writer_;                    // Only used by the flush thread
+  std::mutex stop_mutex_;                   // Protects stop_
+  std::condition_variable stop_cv_;         // Wakes the flush thread to stop
+  bool stop_ = false;                       // Set when the set is destroyed
+  std::thread flusher_;                     // Drains the rings periodically
+
+public:
+  // Records the operations on |inner| to |path|. Each thread gets a ring
+  // of |ring_capacity| records (rounded up to a power of two), flushed
+  // every |flush_interval|.
+  RecordingHashSet(std::unique_ptr<Inner> inner, const std::string &path,
+                   size_t max_threads = 256, size_t ring_capacity = 1 << 14,
+                   std::chrono::milliseconds flush_interval =
+                       std::chrono::milliseconds(10))
+      : inner_(std::move(inner)), rings_(new Ring[max_threads]),
+        max_threads_(max_threads), id_(NextRecordingSetId()),
+        pool_(std::make_shared<RecordingRingPool>()), ring_capacity_(1),
+        start_(Clock::now()), writer_(path) {
+    // Hand out the lowest indices first, so thread ids stay dense
+    for (size_t i = max_threads_; i > 0; i--) {
+      pool_->free.push_back(i - 1);
+    }
+    while (ring_capacity_ < ring_capacity) {
+      ring_capacity_ *= 2;
+    }
+    flusher_ = std::thread([this, flush_interval] {
+      std::unique_lock<std::mutex> lock(stop_mutex_);
+      auto stopped = [this] { return stop_; };
+      while (!stop_cv_.wait_for(lock, flush_interval, stopped)) {
+        FlushRings();
+      }
+    });
+  }
+
+  ~RecordingHashSet() override {
+    {
+      std::scoped_lock<std::mutex> lock(stop_mutex_);
+      stop_ = true;
+    }
+    stop_cv_.notify_one();
+    flusher_.join();
+    // No thread may use the set any more, so this drains everything
+    FlushRings();
+    for (size_t i = 0; i < max_threads_; i++) {
+      delete[] rings_[i].records.load();
+    }
+  }
+
+  RecordingHashSet(const RecordingHashSet &) = delete;
+  RecordingHashSet &operator=(const RecordingHashSet &) = delete;
+
+  bool Add(T elem) final {
+    uint64_t timestamp = Now();
+    bool result = inner_->Add(elem);
+    Record(trace::Operation::kAdd, elem, result, timestamp);
+    return result;
+  }
+
+  bool Remove(T elem) final {
+    uint64_t timestamp = Now();
+    bool result = inner_->Remove(elem);
+    Record(trace::Operation::kRemove, elem, result, timestamp);
+    return result;
+  }
+
+  [[nodiscard]] bool Contains(T elem) final {
+    uint64_t timestamp = Now();
+    bool result = inner_->Contains(elem);
+    Record(trace::Operation::kContains, elem, result, timestamp);
+    return result;
+  }
+
+  [[nodiscard]] size_t Size() const final { return inner_->Size(); }
+
+  // Not recorded, since it is not in the trace format
+  void ForEach(const std::function<void(const T &)> &f) final {
+    inner_->ForEach(f);
+  }
+
+  // Returns the number of operations that were not recorded
+  [[nodiscard]] uint64_t Dropped() const { return dropped_.load(); }
+
+  // Returns false if the trace file could not be created or written
+  [[nodiscard]] bool Ok() const { return writer_.Ok(); }
+
+private:
+  uint64_t Now() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start_)
+            .count());
+  }
+
+  static uint64_t TraceKey(const T &elem) {
+    if constexpr (std::is_integral_v<T>) {
+      return static_cast<uint64_t>(elem);
+    } else {
+      return static_cast<uint64_t>(std::hash<T>()(elem));
+    }
+  }
+
+  void Record(trace::Operation operation, const T &elem, bool result,
+              uint64_t timestamp) {
+    size_t thread_index =
+        RecordingRingLeases::RingOf(id_, pool_, max_threads_);
+    if (thread_index == max_threads_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Ring &ring = rings_[thread_index];
+
+    trace::Record *records = ring.records.load(std::memory_order_relaxed);
+    if (records == nullptr) {
+      // Only this thread writes the pointer, and the flush thread reads it
+      records = new trace::Record[ring_capacity_];
+      ring.records.store(records, std::memory_order_release);
+    }
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.cached_tail == ring_capacity_) {
+      ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+      if (head - ring.cached_tail == ring_capacity_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    trace::Record &record = records[head & (ring_capacity_ - 1)];
+    record.timestamp_nanos = timestamp;
+    record.key = TraceKey(elem);
+    record.thread_id = static_cast<uint32_t>(thread_index);
+    record.operation = operation;
+    record.result = result ? 1 : 0;
+    record.reserved = 0;
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  // Writes out the queued records of every ring. Only called by the flush
+  // thread, or by the destructor once it has stopped.
+  void FlushRings() {
+    for (size_t i = 0; i < max_threads_; i++) {
+      Ring &ring = rings_[i];
+      trace::Record *records = ring.records.load(std::memory_order_acquire);
+      if (records == nullptr) {
+        continue;
+      }
+      uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+      uint64_t head = ring.head.load(std::memory_order_acquire);
+      while (tail != head) {
+        // Write up to the end of the ring, then wrap around
+        size_t offset = tail & (ring_capacity_ - 1);
+        size_t count = std::min<uint64_t>(head - tail, ring_capacity_ - offset);
+        writer_.Write(records + offset, count);
+        tail += count;
+      }
+      ring.tail.store(tail, std::memory_order_release);
+    }
+    writer_.Flush();
+  }
+};
+
+#endif // HASH_SET_RECORDING_H
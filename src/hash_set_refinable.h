@@ -19,6 +19,7 @@ private:
       mutexes_;                    // Resizable vector of mutexes
   std::shared_mutex resize_mutex_; // Shared mutex for resizing
   size_t capacity_;                // The number of buckets
+  size_t stripes_;                 // The initial number of buckets
   std::atomic<size_t> size_;       // The number of elements
 
   // We have a vector of unique pointers to allow for the resizing
@@ -39,7 +40,7 @@ public:
   explicit HashSetRefinable(size_t initial_capacity)
       : table_(std::vector<std::vector<T>>(initial_capacity, std::vector<T>())),
         mutexes_(std::vector<std::unique_ptr<std::mutex>>(initial_capacity)),
-        capacity_(initial_capacity), size_(0) {
+        capacity_(initial_capacity), stripes_(initial_capacity), size_(0) {
     for (size_t i = 0; i < mutexes_.size(); i++) {
       mutexes_[i] = std::make_unique<std::mutex>();
     }
@@ -118,6 +119,31 @@ public:
   // Get the size of the hashset
   [[nodiscard]] size_t Size() const final { return size_.load(); }
 
+  // Call |f| on every element, holding the resize lock in write mode
+  void ForEach(const std::function<void(const T &)> &f) final {
+    std::unique_lock<std::shared_mutex> rl(resize_mutex_);
+    for (const auto &bucket : table_) {
+      for (const T &elem : bucket) {
+        f(elem);
+      }
+    }
+  }
+
+  // Get the number of stripes. Stripe s holds the buckets whose index is
+  // s modulo the initial capacity, which keep their elements in the same
+  // stripe when the capacity doubles.
+  [[nodiscard]] size_t Stripes() const { return stripes_; }
+
+  // Append the elements of |stripe| to |out|, holding the resize lock in
+  // read mode and each bucket's lock in turn
+  void CopyStripe(size_t stripe, std::vector<T> &out) {
+    std::shared_lock<std::shared_mutex> rl(resize_mutex_);
+    for (size_t i = stripe; i < capacity_; i += stripes_) {
+      std::scoped_lock<std::mutex> lock(*mutexes_[i]);
+      out.insert(out.end(), table_[i].begin(), table_[i].end());
+    }
+  }
+
 private:
   void resize() {
     size_t old_capacity = capacity_;
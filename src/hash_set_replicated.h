@@ -0,0 +1,333 @@
+#ifndef HASH_SET_REPLICATED_H
+#define HASH_SET_REPLICATED_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_buckets.h"
+#include "src/hash_set_striped.h"
+
+// An in-process stream of the changes made to a set, read by any number
+// of subscribers at their own pace. Deltas are kept until every
+// subscriber has read them, so a subscriber that stops reading makes the
+// stream grow.
+template <typename T> class ChangeStream {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Delta {
+    uint64_t sequence;       // 1 for the first delta of the stream
+    Clock::time_point added; // When the delta was appended
+    T elem;                  // The element that was added or removed
+    bool add;                // True for an Add, false for a Remove
+  };
+
+private:
+  // The cursor of a subscriber that unsubscribed, which never holds back
+  // trimming
+  static constexpr uint64_t kUnsubscribed =
+      std::numeric_limits<uint64_t>::max();
+
+  mutable std::mutex mutex_;      // Protects all members
+  std::deque<Delta> deltas_;      // Not yet read by every subscriber
+  uint64_t head_ = 0;             // The sequence of the last delta
+  std::vector<uint64_t> cursors_; // The last sequence read, by subscriber
+
+public:
+  // Append a delta. Without subscribers it is dropped right away.
+  void Append(const T &elem, bool add) {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    head_++;
+    if (std::any_of(cursors_.begin(), cursors_.end(),
+                    [](uint64_t cursor) { return cursor != kUnsubscribed; })) {
+      deltas_.push_back(Delta{head_, Clock::now(), elem, add});
+    }
+  }
+
+  // Returns a new subscriber, which reads the deltas appended from now on
+  size_t Subscribe() {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    cursors_.push_back(head_);
+    return cursors_.size() - 1;
+  }
+
+  // Stop reading as |subscriber|, releasing the deltas it did not read
+  void Unsubscribe(size_t subscriber) {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    cursors_[subscriber] = kUnsubscribed;
+    Trim();
+  }
+
+  // Move up to |max| unread deltas of |subscriber| into |out|, and return
+  // how many
+  size_t Read(size_t subscriber, std::vector<Delta> &out, size_t max) {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    uint64_t &cursor = cursors_[subscriber];
+    if (deltas_.empty() || cursor == head_) {
+      return 0;
+    }
+    auto begin = deltas_.begin() +
+                 static_cast<std::ptrdiff_t>(cursor + 1 -
+                                             deltas_.front().sequence);
+    auto count = std::min<size_t>(
+        max, static_cast<size_t>(deltas_.end() - begin));
+    out.insert(out.end(), begin, begin + static_cast<std::ptrdiff_t>(count));
+    cursor += count;
+    Trim();
+    return count;
+  }
+
+  // Returns the sequence of the last delta appended
+  [[nodiscard]] uint64_t Head() const {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    return head_;
+  }
+
+  // Returns when the delta after |sequence| was appended, or now if there
+  // is none yet
+  [[nodiscard]] Clock::time_point AddedAfter(uint64_t sequence) const {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    if (deltas_.empty() || sequence >= deltas_.back().sequence) {
+      return Clock::now();
+    }
+    // The delta may already be trimmed if it was read but is still being
+    // applied, in which case the oldest kept delta is the best estimate
+    if (sequence + 1 < deltas_.front().sequence) {
+      return deltas_.front().added;
+    }
+    return deltas_[static_cast<size_t>(sequence + 1 -
+                                       deltas_.front().sequence)]
+        .added;
+  }
+
+  // Returns the number of deltas kept for subscribers
+  [[nodiscard]] size_t Pending() const {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    return deltas_.size();
+  }
+
+private:
+  // Drops the deltas every subscriber has read. The mutex must be held.
+  void Trim() {
+    uint64_t oldest = *std::min_element(cursors_.begin(), cursors_.end());
+    while (!deltas_.empty() && deltas_.front().sequence <= oldest) {
+      deltas_.pop_front();
+    }
+  }
+};
+
+// A HashSetStriped that publishes every Add and Remove that changed it to
+// a ChangeStream, for HashSetReplica to follow.
+//
+// Changes to an element must reach the stream in the order they were
+// made to the set, or a replica could apply an Add after the Remove that
+// followed it. Each change therefore holds one of kOrderStripes mutexes,
+// chosen by the hash of the element, across the change and its append.
+// Lookups take no extra lock. All writers share the stream's mutex, so
+// the primary suits read-mostly workloads.
+template <typename T, typename Hash = std::hash<T>>
+class HashSetPrimary : public HashSetBase<T> {
+private:
+  static constexpr size_t kOrderStripes = 64;
+
+  // Each order mutex gets its own cache line
+  struct alignas(64) OrderMutex : std::mutex {};
+
+  HashSetStriped<T, VectorBucket<T>, Hash> set_; // The primary copy
+  std::unique_ptr<OrderMutex[]> order_;          // Orders the deltas
+  ChangeStream<T> stream_;                       // The changes to set_
+  Hash hash_;                                    // Picks the order mutex
+
+public:
+  explicit HashSetPrimary(size_t initial_capacity)
+      : set_(initial_capacity), order_(new OrderMutex[kOrderStripes]) {}
+
+  // Add an element to the hash set
+  bool Add(T elem) final {
+    std::scoped_lock<std::mutex> lock(OrderMutexOf(elem));
+    bool added = set_.Add(elem);
+    if (added) {
+      stream_.Append(elem, true);
+    }
+    return added;
+  }
+
+  // Remove an element from the hash set
+  bool Remove(T elem) final {
+    std::scoped_lock<std::mutex> lock(OrderMutexOf(elem));
+    bool removed = set_.Remove(elem);
+    if (removed) {
+      stream_.Append(elem, false);
+    }
+    return removed;
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] bool Contains(T elem) final { return set_.Contains(elem); }
+
+  // Get the size of the hashset
+  [[nodiscard]] size_t Size() const final { return set_.Size(); }
+
+  // Call |f| on every element
+  void ForEach(const std::function<void(const T &)> &f) final {
+    set_.ForEach(f);
+  }
+
+  // Returns the stream of changes
+  ChangeStream<T> &Stream() { return stream_; }
+
+  // Subscribe to the stream, calling |f| on every current element first.
+  // No change is made meanwhile, so the subscriber's first delta follows
+  // exactly the elements it was given.
+  size_t Subscribe(const std::function<void(const T &)> &f) {
+    ArrayLock<OrderMutex> lock(order_.get(), kOrderStripes);
+    set_.ForEach(f);
+    return stream_.Subscribe();
+  }
+
+private:
+  OrderMutex &OrderMutexOf(const T &elem) {
+    return order_[hash_(elem) % kOrderStripes];
+  }
+};
+
+// A read-only copy of a HashSetPrimary, kept up to date by a background
+// thread that applies the primary's changes in batches.
+//
+// Readers query the replica's own stripes, so a replica per NUMA node
+// keeps lookups off the interconnect: construct it from a thread pinned
+// to the node's CPUs. The table is allocated there, and the apply thread
+// inherits the CPU affinity of its creator, so the buckets it allocates
+// are node-local too.
+//
+// The replica trails the primary. Lag() reports by how many deltas, and
+// for how long the oldest unapplied delta has waited.
+template <typename T, typename Hash = std::hash<T>> class HashSetReplica {
+private:
+  using Clock = std::chrono::steady_clock;
+  using Delta = typename ChangeStream<T>::Delta;
+
+  HashSetPrimary<T, Hash> &primary_;              // The followed set
+  HashSetStriped<T, VectorBucket<T>, Hash> set_;  // The local copy
+  size_t subscriber_;                             // In the primary's stream
+  size_t max_batch_;                              // Deltas applied at once
+  std::mutex apply_mutex_;                        // Serializes applying
+  std::vector<Delta> batch_;                      // Under apply_mutex_
+  std::atomic<uint64_t> applied_{0};              // The last applied delta
+  std::atomic<uint64_t> max_delay_nanos_{0};      // Longest append to apply
+  std::mutex stop_mutex_;                         // Protects stop_
+  std::condition_variable stop_cv_;               // Wakes the apply thread
+  bool stop_ = false;                             // Set on destruction
+  std::thread applier_;                           // Applies periodically
+
+public:
+  struct Lag {
+    uint64_t deltas; // Deltas appended but not yet applied
+    uint64_t nanos;  // Age of the oldest of them, or 0 if there is none
+  };
+
+  // Copy |primary|, then apply its changes every |apply_interval|, up to
+  // |max_batch| deltas at a time, until caught up
+  explicit HashSetReplica(HashSetPrimary<T, Hash> &primary,
+                          size_t max_batch = 1024,
+                          std::chrono::microseconds apply_interval =
+                              std::chrono::microseconds(1000))
+      : primary_(primary), set_(std::max<size_t>(primary.Size() / 4, 16)),
+        max_batch_(max_batch) {
+    subscriber_ =
+        primary_.Subscribe([this](const T &elem) { set_.Add(elem); });
+    applied_ = primary_.Stream().Head();
+    applier_ = std::thread([this, apply_interval] {
+      std::unique_lock<std::mutex> lock(stop_mutex_);
+      auto stopped = [this] { return stop_; };
+      while (!stop_cv_.wait_for(lock, apply_interval, stopped)) {
+        ApplyPending();
+      }
+    });
+  }
+
+  ~HashSetReplica() {
+    {
+      std::scoped_lock<std::mutex> lock(stop_mutex_);
+      stop_ = true;
+    }
+    stop_cv_.notify_one();
+    applier_.join();
+    primary_.Stream().Unsubscribe(subscriber_);
+  }
+
+  HashSetReplica(const HashSetReplica &) = delete;
+  HashSetReplica &operator=(const HashSetReplica &) = delete;
+
+  // Check if an element is contained in the replica
+  [[nodiscard]] bool Contains(const T &elem) { return set_.Contains(elem); }
+
+  // Get the size of the replica
+  [[nodiscard]] size_t Size() const { return set_.Size(); }
+
+  // Call |f| on every element of the replica
+  void ForEach(const std::function<void(const T &)> &f) { set_.ForEach(f); }
+
+  // Apply every delta appended so far, and return how many. Readers see
+  // the replica catch up batch by batch.
+  size_t ApplyPending() {
+    std::scoped_lock<std::mutex> lock(apply_mutex_);
+    size_t total = 0;
+    while (true) {
+      batch_.clear();
+      size_t count =
+          primary_.Stream().Read(subscriber_, batch_, max_batch_);
+      if (count == 0) {
+        return total;
+      }
+      for (const Delta &delta : batch_) {
+        if (delta.add) {
+          set_.Add(delta.elem);
+        } else {
+          set_.Remove(delta.elem);
+        }
+      }
+      auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - batch_.front().added);
+      auto delay_nanos = static_cast<uint64_t>(delay.count());
+      if (delay_nanos > max_delay_nanos_.load()) {
+        max_delay_nanos_ = delay_nanos;
+      }
+      applied_ = batch_.back().sequence;
+      total += count;
+    }
+  }
+
+  // Returns how far the replica trails the primary
+  [[nodiscard]] Lag CurrentLag() const {
+    const ChangeStream<T> &stream = primary_.Stream();
+    uint64_t applied = applied_.load();
+    uint64_t head = stream.Head();
+    if (head <= applied) {
+      return Lag{0, 0};
+    }
+    auto age = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - stream.AddedAfter(applied));
+    return Lag{head - applied, static_cast<uint64_t>(age.count())};
+  }
+
+  // Returns the longest time a delta waited between its append and the
+  // end of the batch that applied it
+  [[nodiscard]] uint64_t MaxDelayNanos() const {
+    return max_delay_nanos_.load();
+  }
+};
+
+#endif // HASH_SET_REPLICATED_H
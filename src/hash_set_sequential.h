@@ -83,6 +83,15 @@ public:
 
   // Get the size of the hashset
   [[nodiscard]] size_t Size() const final { return size_; }
+
+  // Call |f| on every element
+  void ForEach(const std::function<void(const T &)> &f) final {
+    for (const auto &bucket : table_) {
+      for (const T &elem : bucket) {
+        f(elem);
+      }
+    }
+  }
 };
 
 #endif // HASH_SET_SEQUENTIAL_H
@@ -0,0 +1,476 @@
+#ifndef HASH_SET_SHARED_H
+#define HASH_SET_SHARED_H
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_static.h"
+
+// A fixed-capacity hash set that lives entirely in a named POSIX shared
+// memory segment, so that several processes on one host share it. It is
+// created by the first process that opens the name and found by the
+// others, or inherited across fork() in a prefork server.
+//
+// The segment holds a header, the stripes and the slots, at offsets
+// recorded in the header, so it contains no pointers and may be mapped at
+// a different address in every process. Like HashSetStriped, elements are
+// spread over stripes by hash, and each stripe has its own lock. Here a
+// stripe also owns a fixed range of slots, used as a small open-addressing
+// table with linear probing, so an operation takes a single lock. Remove
+// shifts the following elements back instead of leaving tombstones.
+//
+// The locks are process-shared robust mutexes: when a process dies
+// holding one, the next process to take it rebuilds the stripe from its
+// slots, which repairs an interrupted Add or Remove. A process that dies
+// while creating the segment leaves it never set up; the next process to
+// open the name waits kOpenTimeout for it, then removes it and creates
+// the segment anew.
+//
+// The set does not grow, since the other processes could not follow the
+// remapping: an Add whose stripe is full returns false and is counted in
+// Overflows(). Size the capacity to about 1.5 times the expected number
+// of elements. Elements are copied into the segment as bytes, so T must
+// be trivially copyable, and std::hash<T> must agree between the
+// processes, as it does for integers.
+template <typename T> class HashSetShared : public HashSetBase<T> {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "HashSetShared stores elements as bytes");
+  static_assert(std::atomic<size_t>::is_always_lock_free,
+                "Sizes are shared as atomics between processes");
+
+private:
+  static constexpr uint64_t kMagic = 0x48535348'41524544; // "HSSHARED"
+
+  // How long Open waits for the creating process to set up the segment
+  static constexpr std::chrono::seconds kOpenTimeout{5};
+
+  struct Header {
+    uint64_t magic;                // kMagic, once the segment is set up
+    uint64_t elem_size;            // sizeof(T) of the creating process
+    uint64_t stripe_count;         // The number of stripes
+    uint64_t slots_per_stripe;     // The number of slots of each stripe
+    uint64_t stripes_offset;       // Where the stripes start
+    uint64_t sizes_offset;         // Where the stripes' sizes start
+    uint64_t slots_offset;         // Where the slots start
+    std::atomic<uint32_t> ready;   // Set once the segment is set up
+    std::atomic<size_t> overflows; // Adds that found their stripe full
+  };
+
+  struct alignas(64) Stripe {
+    pthread_mutex_t mutex;       // Process-shared and robust
+    std::atomic<size_t> repairs; // Times a dead owner's stripe was rebuilt
+  };
+
+  struct Slot {
+    T elem;    // The element, if full
+    bool full; // Whether the slot holds an element
+  };
+
+  // Unlocks a stripe when it goes out of scope
+  class StripeLock {
+  private:
+    pthread_mutex_t *mutex_;
+
+  public:
+    explicit StripeLock(pthread_mutex_t *mutex) : mutex_(mutex) {}
+    ~StripeLock() { pthread_mutex_unlock(mutex_); }
+
+    StripeLock(const StripeLock &) = delete;
+    StripeLock &operator=(const StripeLock &) = delete;
+  };
+
+  int fd_ = -1;                          // The shared memory object
+  void *base_ = MAP_FAILED;              // Where the segment is mapped here
+  size_t bytes_ = 0;                     // The size of the segment
+  Header *header_ = nullptr;             // At offset 0 of the segment
+  Stripe *stripes_ = nullptr;            // At header_->stripes_offset
+  std::atomic<size_t> *sizes_ = nullptr; // At header_->sizes_offset
+  Slot *slots_ = nullptr;                // At header_->slots_offset
+  size_t stripe_count_ = 0;              // Copied from the header
+  size_t slots_per_stripe_ = 0;          // Copied from the header
+
+public:
+  // Open the set named |name|, which must start with a slash, or create
+  // it with room for |capacity| elements in |stripe_count| stripes if it
+  // does not exist. Check Ok() before use. A segment that is still not
+  // set up after kOpenTimeout is taken to be left by a creator that died,
+  // and is removed and created once more.
+  HashSetShared(const std::string &name, size_t capacity,
+                size_t stripe_count = 64) {
+    stripe_count = stripe_count == 0 ? 1 : stripe_count;
+    for (int attempt = 0; attempt < 2; attempt++) {
+      fd_ = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd_ >= 0) {
+        if (!Create(capacity, stripe_count)) {
+          // Leave no half-made segment for other processes to wait on
+          shm_unlink(name.c_str());
+        }
+        return;
+      }
+      if (errno != EEXIST) {
+        return;
+      }
+      fd_ = shm_open(name.c_str(), O_RDWR, 0600);
+      // The name may have been removed since, then it is free again
+      if (fd_ >= 0 && (Open() || !UnlinkIfSame(name))) {
+        return;
+      }
+      Close();
+    }
+  }
+
+  ~HashSetShared() override { Close(); }
+
+  HashSetShared(const HashSetShared &) = delete;
+  HashSetShared &operator=(const HashSetShared &) = delete;
+
+  // Remove the name of the set; processes that have it open keep using it
+  static bool Unlink(const std::string &name) {
+    return shm_unlink(name.c_str()) == 0;
+  }
+
+  // Returns false if the segment could not be created or opened, or was
+  // created for another element type
+  [[nodiscard]] bool Ok() const { return header_ != nullptr; }
+
+  // Add an element to the hash set
+  bool Add(T elem) final {
+    size_t hash = Hash(elem);
+    size_t stripe = hash % stripe_count_;
+    StripeLock lock = Lock(stripe);
+
+    Slot *slots = StripeSlots(stripe);
+    size_t home = Home(hash);
+    for (size_t probe = 0; probe < slots_per_stripe_; probe++) {
+      Slot &slot = slots[(home + probe) % slots_per_stripe_];
+      if (!slot.full) {
+        slot.elem = elem;
+        slot.full = true;
+        sizes_[stripe].fetch_add(1);
+        return true;
+      }
+      if (slot.elem == elem) {
+        return false;
+      }
+    }
+    header_->overflows.fetch_add(1);
+    return false;
+  }
+
+  // Remove an element from the hashset
+  bool Remove(T elem) final {
+    size_t hash = Hash(elem);
+    size_t stripe = hash % stripe_count_;
+    StripeLock lock = Lock(stripe);
+
+    Slot *slots = StripeSlots(stripe);
+    size_t hole = Find(slots, hash, elem);
+    if (hole == slots_per_stripe_) {
+      return false;
+    }
+
+    // Shift back the elements after the hole that may not probe past it
+    size_t next = hole;
+    for (size_t probe = 1; probe < slots_per_stripe_; probe++) {
+      next = (next + 1) % slots_per_stripe_;
+      if (!slots[next].full) {
+        break;
+      }
+      size_t home = Home(Hash(slots[next].elem));
+      if (Distance(home, next) >= Distance(hole, next)) {
+        slots[hole].elem = slots[next].elem;
+        hole = next;
+      }
+    }
+    slots[hole].full = false;
+    sizes_[stripe].fetch_sub(1);
+    return true;
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] bool Contains(T elem) final {
+    size_t hash = Hash(elem);
+    size_t stripe = hash % stripe_count_;
+    StripeLock lock = Lock(stripe);
+    return Find(StripeSlots(stripe), hash, elem) != slots_per_stripe_;
+  }
+
+  // Get the size of the hashset, summed over the stripes
+  [[nodiscard]] size_t Size() const final {
+    size_t size = 0;
+    for (size_t i = 0; i < stripe_count_; i++) {
+      size += sizes_[i].load();
+    }
+    return size;
+  }
+
+  // Call |f| on every element, locking one stripe at a time
+  void ForEach(const std::function<void(const T &)> &f) final {
+    for (size_t stripe = 0; stripe < stripe_count_; stripe++) {
+      StripeLock lock = Lock(stripe);
+      Slot *slots = StripeSlots(stripe);
+      for (size_t i = 0; i < slots_per_stripe_; i++) {
+        if (slots[i].full) {
+          f(slots[i].elem);
+        }
+      }
+    }
+  }
+
+  // Returns the number of Adds, by any process, that found no free slot
+  [[nodiscard]] size_t Overflows() const { return header_->overflows.load(); }
+
+  // Returns the number of stripes rebuilt after their owner died
+  [[nodiscard]] size_t Repairs() const {
+    size_t repairs = 0;
+    for (size_t i = 0; i < stripe_count_; i++) {
+      repairs += stripes_[i].repairs.load();
+    }
+    return repairs;
+  }
+
+private:
+  static size_t RoundUp(size_t bytes) { return (bytes + 63) / 64 * 64; }
+
+  // std::hash is the identity for integers, which would give runs of
+  // consecutive keys runs of consecutive slots, and long probes
+  static size_t Hash(const T &elem) {
+    return static_cast<size_t>(
+        StaticHashMix(static_cast<uint64_t>(std::hash<T>()(elem))));
+  }
+
+  Slot *StripeSlots(size_t stripe) const {
+    return slots_ + stripe * slots_per_stripe_;
+  }
+
+  // The first slot probed within the stripe. The stripe was chosen by the
+  // low part of |hash|, so this uses the rest of it.
+  size_t Home(size_t hash) const {
+    return hash / stripe_count_ % slots_per_stripe_;
+  }
+
+  // The number of probes from |from| forward to |to| within a stripe
+  size_t Distance(size_t from, size_t to) const {
+    return (to + slots_per_stripe_ - from) % slots_per_stripe_;
+  }
+
+  // Returns the slot of |elem| in |slots|, or slots_per_stripe_
+  size_t Find(const Slot *slots, size_t hash, const T &elem) const {
+    size_t home = Home(hash);
+    for (size_t probe = 0; probe < slots_per_stripe_; probe++) {
+      size_t i = (home + probe) % slots_per_stripe_;
+      if (!slots[i].full) {
+        break;
+      }
+      if (slots[i].elem == elem) {
+        return i;
+      }
+    }
+    return slots_per_stripe_;
+  }
+
+  // Locks |stripe|, repairing it first if its last owner died holding it
+  StripeLock Lock(size_t stripe) {
+    pthread_mutex_t *mutex = &stripes_[stripe].mutex;
+    if (pthread_mutex_lock(mutex) == EOWNERDEAD) {
+      Repair(stripe);
+      pthread_mutex_consistent(mutex);
+    }
+    return StripeLock(mutex);
+  }
+
+  // Rebuilds the slots of |stripe| from the elements it holds. An Add or
+  // Remove cut short may have left an element twice, or out of the probe
+  // sequence of its home slot, which this fixes along with the size.
+  void Repair(size_t stripe) {
+    Slot *slots = StripeSlots(stripe);
+    std::vector<T> elems;
+    for (size_t i = 0; i < slots_per_stripe_; i++) {
+      if (slots[i].full) {
+        elems.push_back(slots[i].elem);
+        slots[i].full = false;
+      }
+    }
+    size_t size = 0;
+    for (const T &elem : elems) {
+      size_t home = Home(Hash(elem));
+      for (size_t probe = 0; probe < slots_per_stripe_; probe++) {
+        Slot &slot = slots[(home + probe) % slots_per_stripe_];
+        if (!slot.full) {
+          slot.elem = elem;
+          slot.full = true;
+          size++;
+          break;
+        }
+        if (slot.elem == elem) {
+          break;
+        }
+      }
+    }
+    sizes_[stripe].store(size);
+    stripes_[stripe].repairs.fetch_add(1);
+  }
+
+  // Unmaps and closes the segment
+  void Close() {
+    if (base_ != MAP_FAILED) {
+      munmap(base_, bytes_);
+      base_ = MAP_FAILED;
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  // Removes |name| if it still refers to the segment open here, rather
+  // than to one another process created since. Returns false if it did
+  // not remove it.
+  bool UnlinkIfSame(const std::string &name) const {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      return errno == ENOENT;
+    }
+    struct stat ours {};
+    struct stat named {};
+    bool same = fstat(fd_, &ours) == 0 && fstat(fd, &named) == 0 &&
+                ours.st_dev == named.st_dev && ours.st_ino == named.st_ino;
+    close(fd);
+    return same && shm_unlink(name.c_str()) == 0;
+  }
+
+  // Maps the first |bytes| of the segment, and returns false on error
+  bool Map(size_t bytes) {
+    base_ = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base_ == MAP_FAILED) {
+      return false;
+    }
+    bytes_ = bytes;
+    return true;
+  }
+
+  // Sets up a new segment, and returns false on error
+  bool Create(size_t capacity, size_t stripe_count) {
+    size_t slots_per_stripe = (capacity + stripe_count - 1) / stripe_count;
+    slots_per_stripe = slots_per_stripe == 0 ? 1 : slots_per_stripe;
+    size_t stripes_offset = RoundUp(sizeof(Header));
+    size_t sizes_offset = stripes_offset + stripe_count * sizeof(Stripe);
+    size_t slots_offset =
+        RoundUp(sizes_offset + stripe_count * sizeof(std::atomic<size_t>));
+    size_t bytes =
+        slots_offset + stripe_count * slots_per_stripe * sizeof(Slot);
+    if (ftruncate(fd_, static_cast<off_t>(bytes)) != 0 || !Map(bytes)) {
+      return false;
+    }
+
+    auto *base = static_cast<char *>(base_);
+    auto *header = new (base) Header{0, sizeof(T), stripe_count,
+                                     slots_per_stripe, stripes_offset,
+                                     sizes_offset, slots_offset, {0}, {0}};
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    for (size_t i = 0; i < stripe_count; i++) {
+      auto *stripe = new (base + stripes_offset + i * sizeof(Stripe)) Stripe;
+      pthread_mutex_init(&stripe->mutex, &attributes);
+      stripe->repairs.store(0);
+    }
+    new (base + sizes_offset) std::atomic<size_t>[stripe_count]();
+    pthread_mutexattr_destroy(&attributes);
+    // The segment starts zeroed, so every slot is empty
+    new (base + slots_offset) Slot[stripe_count * slots_per_stripe];
+
+    header->magic = kMagic;
+    header->ready.store(1);
+    Attach();
+    return true;
+  }
+
+  // Attaches to a segment set up by another process, waiting up to
+  // kOpenTimeout for it to finish. Returns false only if the segment was
+  // still not set up by then; the set may also be not Ok if it is true.
+  bool Open() {
+    auto deadline = std::chrono::steady_clock::now() + kOpenTimeout;
+    auto expired = [deadline] {
+      return std::chrono::steady_clock::now() >= deadline;
+    };
+
+    // The creating process may not have sized the segment yet
+    struct stat status {};
+    while (fstat(fd_, &status) == 0 &&
+           static_cast<size_t>(status.st_size) < sizeof(Header) &&
+           !expired()) {
+      std::this_thread::yield();
+    }
+    auto bytes = static_cast<size_t>(status.st_size);
+    if (bytes < sizeof(Header)) {
+      return !expired();
+    }
+    if (!Map(bytes)) {
+      return true;
+    }
+    auto *header = static_cast<Header *>(base_);
+    while (header->ready.load() == 0) {
+      if (expired()) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+    if (header->magic == kMagic && header->elem_size == sizeof(T) &&
+        Fits(*header, bytes)) {
+      Attach();
+    }
+    return true;
+  }
+
+  // Returns true if the parts |header| describes lie within |bytes|, in
+  // order
+  static bool Fits(const Header &header, size_t bytes) {
+    if (header.stripe_count == 0 || header.slots_per_stripe == 0 ||
+        header.stripes_offset < sizeof(Header) ||
+        header.sizes_offset < header.stripes_offset ||
+        header.slots_offset < header.sizes_offset ||
+        header.slots_offset > bytes) {
+      return false;
+    }
+    uint64_t count = header.stripe_count;
+    return (header.sizes_offset - header.stripes_offset) / sizeof(Stripe) >=
+               count &&
+           (header.slots_offset - header.sizes_offset) /
+                   sizeof(std::atomic<size_t>) >=
+               count &&
+           (bytes - header.slots_offset) / sizeof(Slot) / count >=
+               header.slots_per_stripe;
+  }
+
+  // Points the members at the parts of the mapped segment
+  void Attach() {
+    auto *base = static_cast<char *>(base_);
+    header_ = reinterpret_cast<Header *>(base);
+    stripes_ = reinterpret_cast<Stripe *>(base + header_->stripes_offset);
+    sizes_ = reinterpret_cast<std::atomic<size_t> *>(base +
+                                                     header_->sizes_offset);
+    slots_ = reinterpret_cast<Slot *>(base + header_->slots_offset);
+    stripe_count_ = header_->stripe_count;
+    slots_per_stripe_ = header_->slots_per_stripe;
+  }
+};
+
+#endif // HASH_SET_SHARED_H
@@ -0,0 +1,201 @@
+#ifndef HASH_SET_STATIC_H
+#define HASH_SET_STATIC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+// The finalizer of MurmurHash3, which spreads every input bit over the
+// whole word
+constexpr uint64_t StaticHashMix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDull;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// A hash that can run at compile time, which std::hash cannot. Integers
+// are hashed as they are, and strings with FNV-1a.
+template <typename T> struct StaticHash {
+  static_assert(std::is_integral_v<T> ||
+                    std::is_same_v<T, std::string_view>,
+                "StaticHash supports integers and std::string_view");
+
+  constexpr uint64_t operator()(T elem) const {
+    if constexpr (std::is_integral_v<T>) {
+      return static_cast<uint64_t>(elem);
+    } else {
+      uint64_t hash = 0xCBF29CE484222325ull;
+      for (char c : elem) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001B3ull;
+      }
+      return hash;
+    }
+  }
+};
+
+// An immutable hash set of N keys known at build time, such as protocol
+// keywords or reserved ids, whose table is built by the compiler.
+//
+// The keys are spread over N / 2 + 1 buckets by a seeded hash. Each
+// bucket has a pilot, chosen so that hashing its keys with the pilot puts
+// every key of the set in a slot of its own, as in PTHash. Buckets are
+// placed largest first, while most slots are still free. Contains then
+// hashes twice and compares one slot, without a branch or a lock. Slots
+// that hold no key hold the first key, so that they never match another
+// element.
+//
+// It has the read side of HashSetBase, Contains and Size, but does not
+// derive from it, since a class with virtual functions cannot be built at
+// compile time. Construction fails to compile if two keys are equal or
+// have the same 64-bit hash.
+template <typename T, size_t N, typename Hash = StaticHash<T>>
+class StaticHashSet {
+  static_assert(N > 0, "StaticHashSet needs at least one key");
+
+private:
+  // Slots of the table, half of them used
+  static constexpr size_t kTableSize = 2 * N;
+  // Buckets sharing a pilot, about 2 keys each
+  static constexpr size_t kBucketCount = N / 2 + 1;
+  // Pilots tried for a bucket before trying another seed
+  static constexpr uint32_t kMaxPilot = 1 << 16;
+  // Seeds tried before giving up
+  static constexpr uint64_t kMaxSeeds = 16;
+
+  std::array<T, kTableSize> slots_{};           // The keys, by slot
+  std::array<uint32_t, kBucketCount> pilots_{}; // The pilot of each bucket
+  uint64_t seed_ = 0;                           // Spreads keys over buckets
+
+public:
+  // Build the table of |keys|
+  explicit constexpr StaticHashSet(const T (&keys)[N]) {
+    for (uint64_t seed = 0; !Build(keys, seed); seed++) {
+      if (seed == kMaxSeeds) {
+        throw std::invalid_argument("StaticHashSet found no perfect hash");
+      }
+    }
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] constexpr bool Contains(T elem) const {
+    uint64_t hash = Hash()(elem);
+    return slots_[Slot(hash, pilots_[Bucket(hash, seed_)])] == elem;
+  }
+
+  // Get the size of the hashset
+  [[nodiscard]] constexpr size_t Size() const { return N; }
+
+private:
+  static constexpr size_t Bucket(uint64_t hash, uint64_t seed) {
+    return static_cast<size_t>(
+        StaticHashMix(hash + seed * 0xD6E8FEB86659FD93ull) % kBucketCount);
+  }
+
+  static constexpr size_t Slot(uint64_t hash, uint32_t pilot) {
+    return static_cast<size_t>(
+        StaticHashMix(hash ^ (pilot + 1ull) * 0x9E3779B97F4A7C15ull) %
+        kTableSize);
+  }
+
+  // Fill the table using |seed|. Returns false if a bucket found no
+  // pilot.
+  constexpr bool Build(const T (&keys)[N], uint64_t seed) {
+    // Sort the keys by bucket: bucket b has order[starts[b]] up to
+    // order[starts[b + 1]]
+    std::array<uint64_t, N> hashes{};
+    std::array<size_t, kBucketCount + 1> starts{};
+    for (size_t i = 0; i < N; i++) {
+      hashes[i] = Hash()(keys[i]);
+      starts[Bucket(hashes[i], seed) + 1]++;
+    }
+    size_t largest = 0;
+    for (size_t b = 0; b < kBucketCount; b++) {
+      largest = starts[b + 1] > largest ? starts[b + 1] : largest;
+      starts[b + 1] += starts[b];
+    }
+    std::array<size_t, N> order{};
+    std::array<size_t, kBucketCount> next{};
+    for (size_t b = 0; b < kBucketCount; b++) {
+      next[b] = starts[b];
+    }
+    for (size_t i = 0; i < N; i++) {
+      order[next[Bucket(hashes[i], seed)]++] = i;
+    }
+
+    // Keys with the same hash land in the same slot with any pilot
+    for (size_t b = 0; b < kBucketCount; b++) {
+      for (size_t i = starts[b]; i < starts[b + 1]; i++) {
+        for (size_t j = i + 1; j < starts[b + 1]; j++) {
+          if (hashes[order[i]] == hashes[order[j]]) {
+            throw std::invalid_argument(
+                "StaticHashSet keys must have distinct hashes");
+          }
+        }
+      }
+    }
+
+    std::array<bool, kTableSize> taken{};
+    for (size_t size = largest; size > 0; size--) {
+      for (size_t b = 0; b < kBucketCount; b++) {
+        if (starts[b + 1] - starts[b] != size) {
+          continue;
+        }
+        if (!Place(keys, hashes, order, starts[b], starts[b + 1], taken,
+                   pilots_[b])) {
+          return false;
+        }
+      }
+    }
+
+    for (size_t slot = 0; slot < kTableSize; slot++) {
+      if (!taken[slot]) {
+        slots_[slot] = keys[0];
+      }
+    }
+    seed_ = seed;
+    return true;
+  }
+
+  // Find a pilot that puts the keys order[begin] to order[end - 1] in
+  // free slots, and store them there. Returns false if there is none.
+  constexpr bool Place(const T (&keys)[N],
+                       const std::array<uint64_t, N> &hashes,
+                       const std::array<size_t, N> &order, size_t begin,
+                       size_t end, std::array<bool, kTableSize> &taken,
+                       uint32_t &pilot) {
+    for (pilot = 0; pilot < kMaxPilot; pilot++) {
+      size_t placed = begin;
+      while (placed < end && !taken[Slot(hashes[order[placed]], pilot)]) {
+        taken[Slot(hashes[order[placed]], pilot)] = true;
+        placed++;
+      }
+      if (placed == end) {
+        for (size_t i = begin; i < end; i++) {
+          slots_[Slot(hashes[order[i]], pilot)] = keys[order[i]];
+        }
+        return true;
+      }
+      // Free the slots taken with this pilot, and try the next one
+      for (size_t i = begin; i < placed; i++) {
+        taken[Slot(hashes[order[i]], pilot)] = false;
+      }
+    }
+    return false;
+  }
+};
+
+// Build a StaticHashSet, deducing the number of keys, e.g.
+//   constexpr auto kVerbs = MakeStaticHashSet<std::string_view>({"GET"});
+template <typename T, size_t N>
+constexpr StaticHashSet<T, N> MakeStaticHashSet(const T (&keys)[N]) {
+  return StaticHashSet<T, N>(keys);
+}
+
+#endif // HASH_SET_STATIC_H
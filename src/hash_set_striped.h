@@ -6,20 +6,25 @@
 #include <cassert>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <utility>
 #include <vector>
 
 #include "src/hash_set_base.h"
+#include "src/hash_set_buckets.h"
+#include "src/hash_set_policies.h"
+#include "src/seeded_hash.h"
 
 // This is a RAII lock to acquire an array of mutexes in order
 // This makes the resizing easier to implement and safer
-class ArrayLock {
+template <typename Mutex> class ArrayLock {
 private:
-  std::mutex *mutexes_;
+  Mutex *mutexes_;
   size_t size_;
 
 public:
-  ArrayLock(std::mutex *mutexes, size_t size) : mutexes_(mutexes), size_(size) {
+  ArrayLock(Mutex *mutexes, size_t size) : mutexes_(mutexes), size_(size) {
     for (size_t i = 0; i < size_; i++) {
       mutexes_[i].lock();
     }
@@ -32,13 +37,25 @@ public:
   }
 };
 
-template <typename T> class HashSetStriped : public HashSetBase<T> {
+template <typename T, typename Bucket = VectorBucket<T>,
+          typename Hash = std::hash<T>, typename Mutex = std::mutex,
+          typename MaxLoad = DefaultLoadFactor, typename Stats = NoStats>
+class HashSetStriped : public HashSetBase<T> {
 private:
-  std::vector<std::vector<T>> table_; // A vector of vectors for storage
-  std::mutex *mutexes_;               // An array of mutexes
-  size_t mutex_count_;                // The number of elements in the array
-  size_t capacity_;                   // The number of buckets
-  std::atomic<size_t> size_;          // The number of elements
+  // Garbage left by lazy erases in the buckets of one stripe, only touched
+  // under the stripe's lock. Each stripe gets its own cache line.
+  struct alignas(64) StripeGarbage {
+    size_t erased = 0; // Lazy erases since the stripe was last compacted
+  };
+
+  std::vector<Bucket> table_;                // A vector of buckets for storage
+  Mutex *mutexes_;                           // An array of mutexes
+  std::unique_ptr<StripeGarbage[]> garbage_; // Garbage for each mutex
+  size_t mutex_count_;                       // The number of mutexes
+  size_t capacity_;                          // The number of buckets
+  std::atomic<size_t> size_;                 // The number of elements
+  Hash hash_;                                // Maps elements to buckets
+  Stats stats_;                              // Counts the operations
 
   // Mutexes is a constant sized array. When acquireing it all, we can
   // use the ArrayLock for a RAII locking mechanism.
@@ -48,12 +65,26 @@ private:
   //
   // Capacity is only changed when resizing, which is done by one
   // thread at a time, so it is a normal variable.
+  //
+  // With a Bucket whose Erase is lazy, such as TombstoneBucket, Remove
+  // only marks the element as dead. Once a stripe has seen more lazy
+  // erases than it has buckets, the next Add on that stripe compacts all
+  // of the stripe's buckets while it holds the lock anyway. Compact can
+  // also be called from a background thread.
+  //
+  // Hash is stateless by default, but may hold a per-instance seed, as
+  // SeededHash does.
+  //
+  // Mutex, MaxLoad and Stats are the policies of hash_set_policies.h:
+  // the lock of each stripe, when to double the capacity, and what to
+  // count. The defaults behave as the set always has.
 
 public:
   // Initialize the capacity and initialise the table
   explicit HashSetStriped(size_t initial_capacity)
-      : table_(std::vector<std::vector<T>>(initial_capacity, std::vector<T>())),
-        mutexes_(new std::mutex[initial_capacity]),
+      : table_(std::vector<Bucket>(initial_capacity)),
+        mutexes_(new Mutex[initial_capacity]),
+        garbage_(new StripeGarbage[initial_capacity]),
         mutex_count_(initial_capacity), capacity_(initial_capacity), size_(0) {}
 
   ~HashSetStriped() override { delete[] mutexes_; }
@@ -63,23 +94,27 @@ public:
     // If the average bucket size is 4, increase size.
     // Resizing happens at the beginning of Add, so we don't have to
     // explicitly drop the lock acquired during add.
-    if (size_ > 4 * capacity_) {
+    if (MaxLoad::Exceeded(size_, capacity_)) {
       resize();
     }
 
     //  Acquire the correct mutex using a scoped lock
-    size_t hash = std::hash<T>()(elem);
-    std::scoped_lock<std::mutex> lock(mutexes_[hash % mutex_count_]);
+    size_t hash = hash_(elem);
+    size_t stripe = hash % mutex_count_;
+    std::scoped_lock<Mutex> lock(mutexes_[stripe]);
 
-    // If the element is already contained, return false.
-    std::vector<T> &bucket = table_[hash % capacity_];
-    auto it = std::find(bucket.begin(), bucket.end(), elem);
-    if (it != bucket.end()) {
-      return false;
+    if constexpr (Bucket::kLazyErase) {
+      if (garbage_[stripe].erased > capacity_ / mutex_count_) {
+        CompactStripe(stripe);
+      }
     }
 
-    // Add element to the correct bucket
-    bucket.push_back(elem);
+    // Add the element to the correct bucket, unless it is already there
+    bool added = table_[hash % capacity_].Insert(elem);
+    stats_.OnAdd(added);
+    if (!added) {
+      return false;
+    }
     size_.fetch_add(1);
 
     // Return true for successful operation
@@ -89,18 +124,19 @@ public:
   // Remove an element from the hashset
   bool Remove(T elem) final {
     // Acquire the correct mutex using a scoped lock
-    size_t hash = std::hash<T>()(elem);
-    std::scoped_lock<std::mutex> lock(mutexes_[hash % mutex_count_]);
+    size_t hash = hash_(elem);
+    size_t stripe = hash % mutex_count_;
+    std::scoped_lock<Mutex> lock(mutexes_[stripe]);
 
-    // If the element is not included, return false
-    std::vector<T> &bucket = table_[hash % capacity_];
-    auto it = std::find(bucket.begin(), bucket.end(), elem);
-    if (it == bucket.end()) {
+    // Erase the element, if it is included
+    bool removed = table_[hash % capacity_].Erase(elem);
+    stats_.OnRemove(removed);
+    if (!removed) {
       return false;
     }
-
-    // Erase the element
-    bucket.erase(it);
+    if constexpr (Bucket::kLazyErase) {
+      garbage_[stripe].erased++;
+    }
     size_.fetch_sub(1);
     return true;
   }
@@ -108,45 +144,152 @@ public:
   // Check if an element is contained in the hashset
   [[nodiscard]] bool Contains(T elem) final {
     // Acquire the correct mutex using a scoped lock
-    size_t hash = std::hash<T>()(elem);
-    std::scoped_lock<std::mutex> lock(mutexes_[hash % mutex_count_]);
-
-    // Find the element
-    std::vector<T> &bucket = table_[hash % capacity_];
-    auto it = std::find(bucket.begin(), bucket.end(), elem);
+    size_t hash = hash_(elem);
+    std::scoped_lock<Mutex> lock(mutexes_[hash % mutex_count_]);
 
     // Return if the element was found
-    return it != bucket.end();
+    bool found = table_[hash % capacity_].Contains(elem);
+    stats_.OnContains(found);
+    return found;
   }
 
   // Get the size of the hashset
   [[nodiscard]] size_t Size() const final { return size_.load(); }
 
+  // Call |f| on every element, holding all of the stripes' locks
+  void ForEach(const std::function<void(const T &)> &f) final {
+    ArrayLock<Mutex> al(mutexes_, mutex_count_);
+    for (const auto &bucket : table_) {
+      bucket.ForEach([&f](const T &elem) { f(elem); });
+    }
+  }
+
+  // Get the number of stripes, which never changes
+  [[nodiscard]] size_t Stripes() const { return mutex_count_; }
+
+  // Append the elements of |stripe| to |out|, holding only that stripe's
+  // lock. An element belongs to the same stripe however the set grows.
+  void CopyStripe(size_t stripe, std::vector<T> &out) {
+    std::scoped_lock<Mutex> lock(mutexes_[stripe]);
+    for (size_t i = stripe; i < capacity_; i += mutex_count_) {
+      table_[i].ForEach([&out](const T &elem) { out.push_back(elem); });
+    }
+  }
+
+  // Get the counters of the Stats policy
+  [[nodiscard]] const Stats &Statistics() const { return stats_; }
+
+  // Add all of |elems| to the hash set, and return how many were absent.
+  //
+  // The elements are grouped by stripe, so each mutex is acquired once
+  // for all of its elements instead of once per element.
+  size_t AddBatch(const std::vector<T> &elems) {
+    if (MaxLoad::Exceeded(size_ + elems.size(), capacity_)) {
+      resize();
+    }
+
+    // Sort the elements by stripe, keeping their hashes
+    struct Entry {
+      size_t stripe;  // hash % mutex_count_
+      size_t hash;    // The hash of the element
+      const T *elem;  // The element
+    };
+    std::vector<Entry> entries;
+    entries.reserve(elems.size());
+    for (const T &elem : elems) {
+      size_t hash = hash_(elem);
+      entries.push_back(Entry{hash % mutex_count_, hash, &elem});
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &lhs, const Entry &rhs) {
+                return lhs.stripe < rhs.stripe;
+              });
+
+    size_t added = 0;
+    auto begin = entries.begin();
+    while (begin != entries.end()) {
+      size_t stripe = begin->stripe;
+      auto end = std::find_if(begin, entries.end(), [&](const Entry &entry) {
+        return entry.stripe != stripe;
+      });
+
+      size_t added_to_stripe = 0;
+      std::scoped_lock<Mutex> lock(mutexes_[stripe]);
+      for (auto it = begin; it != end; ++it) {
+        bool added_elem = table_[it->hash % capacity_].Insert(*it->elem);
+        stats_.OnAdd(added_elem);
+        if (added_elem) {
+          added_to_stripe++;
+        }
+      }
+      size_.fetch_add(added_to_stripe);
+      added += added_to_stripe;
+      begin = end;
+    }
+    return added;
+  }
+
+  // Reclaim the garbage left by lazy erases in every bucket, one stripe
+  // at a time
+  void Compact() {
+    for (size_t stripe = 0; stripe < mutex_count_; stripe++) {
+      std::scoped_lock<Mutex> lock(mutexes_[stripe]);
+      CompactStripe(stripe);
+    }
+  }
+
 private:
+  // Compact the buckets of |stripe|, whose mutex must be held
+  void CompactStripe(size_t stripe) {
+    for (size_t i = stripe; i < capacity_; i += mutex_count_) {
+      table_[i].Compact();
+    }
+    garbage_[stripe].erased = 0;
+  }
+
   // Double the size of the hashset
   void resize() {
     size_t old_capacity = capacity_;
 
     // Acquire all of the locks except the one we hold
-    ArrayLock al(mutexes_, mutex_count_);
+    ArrayLock<Mutex> al(mutexes_, mutex_count_);
 
     // Check if someone else has already resized
     if (capacity_ != old_capacity) {
       return;
     }
     capacity_ *= 2;
+    stats_.OnResize();
 
     // Create a new, bigger table
-    std::vector<std::vector<T>> new_table(capacity_, std::vector<T>());
-    // Move all old table elements to new one
+    std::vector<Bucket> new_table(capacity_);
+    // Move all old table elements to new one, leaving garbage behind
     for (auto &bucket : table_) {
-      for (T curr_elem : bucket) {
-        size_t curr_hash = std::hash<T>()(curr_elem) % capacity_;
-        new_table[curr_hash].push_back(curr_elem);
-      }
+      bucket.ForEach([&](const T &curr_elem) {
+        size_t curr_hash = hash_(curr_elem) % capacity_;
+        new_table[curr_hash].Append(curr_elem);
+      });
     }
     table_ = new_table;
+    for (size_t i = 0; i < mutex_count_; i++) {
+      garbage_[i].erased = 0;
+    }
   }
 };
 
+// A HashSetStriped whose Remove leaves tombstones, for remove-heavy use
+template <typename T>
+using HashSetStripedTombstone = HashSetStriped<T, TombstoneBucket<T>>;
+
+// A HashSetStriped hashing with a random seed, for keys chosen by clients
+template <typename T>
+using HashSetStripedSeeded =
+    HashSetStriped<T, VectorBucket<T>, SeededHash<T>>;
+
+// A HashSetStriped whose stripe holders may be descheduled, for the
+// preemption scenarios of the benchmarks
+template <typename T>
+using HashSetStripedDescheduling =
+    HashSetStriped<T, VectorBucket<T>, std::hash<T>, DeschedulingLock<>>;
+
 #endif // HASH_SET_STRIPED_H
@@ -0,0 +1,322 @@
+#ifndef HASH_SET_STRIPED_BUFFERED_H
+#define HASH_SET_STRIPED_BUFFERED_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "src/hash_set_striped.h"
+
+// Returns a new id for a HashSetStripedBuffered, never reused in a process
+inline uint64_t NextBufferedSetId() {
+  static std::atomic<uint64_t> next_id{1};
+  return next_id.fetch_add(1);
+}
+
+// A HashSetStriped for insert-heavy workloads, where each thread buffers
+// its Adds and merges them into the shared set in batches.
+//
+// Our ingest threads mostly insert keys nobody else has, and acquiring a
+// stripe mutex per key is their bottleneck. Here Add only inserts into
+// the calling thread's buffer, a small open-addressed hash set, and every
+// |flush_threshold| keys the buffer is merged with HashSetStriped::AddBatch,
+// taking each stripe mutex once per batch. A thread's buffer is also
+// merged when the thread exits.
+//
+// The price is weaker semantics, so this is not a HashSetBase and is not
+// in the registry:
+// - Buffered elements are only visible to other threads once merged, so
+//   Contains in another thread misses them.
+// - Add only knows about the calling thread's buffer. It returns false if
+//   the thread buffered |elem| already, and true otherwise, even if |elem|
+//   is in the shared set or another thread's buffer. Merging finds those
+//   duplicates, and Flush and MergeAll return how many elements were new.
+// - Remove also erases |elem| from the buffers of other threads, so that
+//   a later merge does not bring it back. It locks every buffer.
+// - Size counts buffered elements as if they were new, so it can be too
+//   large until they are merged.
+template <typename T> class HashSetStripedBuffered {
+private:
+  // A thread's elements that are not merged yet, in a vector for
+  // AddBatch, indexed by a linear probing table of positions in it
+  struct Buffer {
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    std::mutex mutex;            // Contended only by merges and Removes
+    std::vector<T> elems;        // Elements added but not merged yet
+    std::vector<uint32_t> index; // Positions in elems, or kEmpty
+    size_t mask;                 // index.size() - 1
+    unsigned shift;              // 64 - log2(index.size())
+
+    Buffer() : index(16, kEmpty), mask(15), shift(60) {}
+
+    // Returns the first slot to probe for |elem|. Fibonacci hashing
+    // spreads std::hash, which is the identity for integers.
+    size_t Home(const T &elem) const {
+      return static_cast<size_t>(
+          (static_cast<uint64_t>(std::hash<T>()(elem)) *
+           0x9e3779b97f4a7c15) >>
+          shift);
+    }
+
+    // Returns the slot of |elem|, or the empty slot where it would go
+    size_t Find(const T &elem) const {
+      size_t slot = Home(elem);
+      while (index[slot] != kEmpty && !(elems[index[slot]] == elem)) {
+        slot = (slot + 1) & mask;
+      }
+      return slot;
+    }
+
+    bool Contains(const T &elem) const { return index[Find(elem)] != kEmpty; }
+
+    // Returns false if |elem| is buffered already
+    bool Insert(const T &elem) {
+      size_t slot = Find(elem);
+      if (index[slot] != kEmpty) {
+        return false;
+      }
+      index[slot] = static_cast<uint32_t>(elems.size());
+      elems.push_back(elem);
+      if (2 * elems.size() > index.size()) {
+        Grow();
+      }
+      return true;
+    }
+
+    // Doubles the slots, keeping them at most half full
+    void Grow() {
+      index.assign(2 * index.size(), kEmpty);
+      mask = index.size() - 1;
+      shift--;
+      for (size_t position = 0; position < elems.size(); position++) {
+        index[Find(elems[position])] = static_cast<uint32_t>(position);
+      }
+    }
+
+    // Returns false if |elem| is not buffered
+    bool Erase(const T &elem) {
+      size_t slot = Find(elem);
+      if (index[slot] == kEmpty) {
+        return false;
+      }
+      // Move the last element into the hole in elems
+      uint32_t position = index[slot];
+      uint32_t last = static_cast<uint32_t>(elems.size() - 1);
+      if (position != last) {
+        index[Find(elems[last])] = position;
+        elems[position] = std::move(elems[last]);
+      }
+      elems.pop_back();
+      // Shift later entries of the probe sequence back into the hole
+      index[slot] = kEmpty;
+      size_t hole = slot;
+      for (size_t next = (slot + 1) & mask; index[next] != kEmpty;
+           next = (next + 1) & mask) {
+        size_t home = Home(elems[index[next]]);
+        // Movable unless its home lies cyclically in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+          index[hole] = index[next];
+          index[next] = kEmpty;
+          hole = next;
+        }
+      }
+      return true;
+    }
+
+    void Clear() {
+      std::fill(index.begin(), index.end(), kEmpty);
+      elems.clear();
+    }
+  };
+
+  // What the set shares with the threads using it. Threads only keep a
+  // weak_ptr to it, so one exiting after the set is gone skips it.
+  struct State {
+    explicit State(size_t initial_capacity) : shared(initial_capacity) {}
+
+    HashSetStriped<T> shared;                     // The merged elements
+    std::mutex buffers_mutex;                     // Protects buffers
+    std::vector<std::unique_ptr<Buffer>> buffers; // One per thread
+    std::atomic<size_t> buffered{0};              // Elements in buffers
+  };
+
+  // The buffers the calling thread holds, one per set it used. They are
+  // merged into their sets when the thread exits.
+  class BufferLeases {
+  private:
+    struct Lease {
+      uint64_t set_id;            // The set the buffer belongs to
+      std::weak_ptr<State> state; // Expired once the set is gone
+      Buffer *buffer;             // Owned by |state|
+    };
+
+    std::vector<Lease> leases_; // At most one per set
+
+  public:
+    ~BufferLeases() {
+      for (const Lease &lease : leases_) {
+        if (auto state = lease.state.lock()) {
+          Release(*state, lease.buffer);
+        }
+      }
+    }
+
+    // Returns the calling thread's buffer for the set |set_id|, creating
+    // it in |state| on first use
+    static Buffer &BufferOf(uint64_t set_id,
+                            const std::shared_ptr<State> &state) {
+      thread_local BufferLeases leases;
+      for (const Lease &lease : leases.leases_) {
+        if (lease.set_id == set_id) {
+          return *lease.buffer;
+        }
+      }
+      Buffer *buffer;
+      {
+        std::scoped_lock<std::mutex> lock(state->buffers_mutex);
+        state->buffers.push_back(std::make_unique<Buffer>());
+        buffer = state->buffers.back().get();
+      }
+      // Leases of sets destroyed since are dropped along the way
+      auto &all = leases.leases_;
+      all.erase(std::remove_if(all.begin(), all.end(),
+                               [](const Lease &lease) {
+                                 return lease.state.expired();
+                               }),
+                all.end());
+      all.push_back(Lease{set_id, state, buffer});
+      return *buffer;
+    }
+  };
+
+  std::shared_ptr<State> state_; // The shared set and the buffers
+  uint64_t id_;                  // Identifies this set
+  size_t flush_threshold_;       // Buffer size for a merge
+
+public:
+  explicit HashSetStripedBuffered(size_t initial_capacity,
+                                  size_t flush_threshold = 256)
+      : state_(std::make_shared<State>(initial_capacity)),
+        id_(NextBufferedSetId()),
+        flush_threshold_(std::clamp<size_t>(flush_threshold, 1,
+                                            Buffer::kEmpty / 4)) {}
+
+  // Add an element to the calling thread's buffer, unless the thread
+  // buffered it already
+  bool Add(T elem) {
+    Buffer &buffer = ThreadBuffer();
+    std::scoped_lock<std::mutex> lock(buffer.mutex);
+    if (!buffer.Insert(elem)) {
+      return false;
+    }
+    state_->buffered.fetch_add(1);
+    if (buffer.elems.size() >= flush_threshold_) {
+      Merge(*state_, buffer);
+    }
+    return true;
+  }
+
+  // Remove an element from every buffer and from the shared set
+  bool Remove(T elem) {
+    bool buffered = false;
+    {
+      std::scoped_lock<std::mutex> lock(state_->buffers_mutex);
+      for (const auto &buffer : state_->buffers) {
+        std::scoped_lock<std::mutex> buffer_lock(buffer->mutex);
+        if (buffer->Erase(elem)) {
+          state_->buffered.fetch_sub(1);
+          buffered = true;
+        }
+      }
+    }
+    // The element may have been merged by another thread as well
+    bool shared = state_->shared.Remove(elem);
+    return buffered || shared;
+  }
+
+  // Check the calling thread's buffer, then the shared set
+  [[nodiscard]] bool Contains(T elem) {
+    Buffer &buffer = ThreadBuffer();
+    {
+      std::scoped_lock<std::mutex> lock(buffer.mutex);
+      if (buffer.Contains(elem)) {
+        return true;
+      }
+    }
+    return state_->shared.Contains(elem);
+  }
+
+  // Get the size of the shared set plus the buffered elements, without
+  // merging. Buffered elements that are in the shared set already, or in
+  // several buffers, are counted more than once.
+  [[nodiscard]] size_t Size() const {
+    return state_->shared.Size() + state_->buffered.load();
+  }
+
+  // Merge all buffers, then call |f| on every element
+  void ForEach(const std::function<void(const T &)> &f) {
+    MergeAll();
+    state_->shared.ForEach(f);
+  }
+
+  // Merge the calling thread's buffer into the shared set, and return the
+  // number of its elements that were not in it yet
+  size_t Flush() {
+    Buffer &buffer = ThreadBuffer();
+    std::scoped_lock<std::mutex> lock(buffer.mutex);
+    return Merge(*state_, buffer);
+  }
+
+  // Merge the buffers of all threads into the shared set, and return the
+  // number of their elements that were not in it yet
+  size_t MergeAll() {
+    size_t added = 0;
+    std::scoped_lock<std::mutex> lock(state_->buffers_mutex);
+    for (const auto &buffer : state_->buffers) {
+      std::scoped_lock<std::mutex> buffer_lock(buffer->mutex);
+      added += Merge(*state_, *buffer);
+    }
+    return added;
+  }
+
+private:
+  // Merges |buffer|, whose mutex must be held, into the shared set, and
+  // returns the number of elements that were not in it yet
+  static size_t Merge(State &state, Buffer &buffer) {
+    if (buffer.elems.empty()) {
+      return 0;
+    }
+    size_t added = state.shared.AddBatch(buffer.elems);
+    state.buffered.fetch_sub(buffer.elems.size());
+    buffer.Clear();
+    return added;
+  }
+
+  // Merges and drops the |buffer| of a thread that exited
+  static void Release(State &state, const Buffer *buffer) {
+    std::scoped_lock<std::mutex> lock(state.buffers_mutex);
+    auto it = std::find_if(
+        state.buffers.begin(), state.buffers.end(),
+        [&](const auto &owned) { return owned.get() == buffer; });
+    if (it == state.buffers.end()) {
+      return;
+    }
+    {
+      std::scoped_lock<std::mutex> buffer_lock((*it)->mutex);
+      Merge(state, **it);
+    }
+    state.buffers.erase(it);
+  }
+
+  // Returns the calling thread's buffer, creating it on first use
+  Buffer &ThreadBuffer() {
+    return BufferLeases::BufferOf(id_, state_);
+  }
+};
+
+#endif // HASH_SET_STRIPED_BUFFERED_H
@@ -0,0 +1,630 @@
+#ifndef HASH_SET_TIERED_H
+#define HASH_SET_TIERED_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_static.h"
+
+// A hash set for more elements than fit in memory, which keeps recently
+// used partitions in memory and spills the others to sorted runs on disk.
+//
+// Elements go to bucket hash % capacity, as in HashSetStriped, and bucket
+// b belongs to partition b % partitions, which has its own lock and its
+// own file. Once more than |memory_limit| elements are in memory, the
+// partitions used least recently are spilled: the elements of their
+// buckets are sorted by hash and appended to the partition's file as a
+// run, with a Bloom filter and the hash of every kFenceInterval-th record
+// kept in memory. A lookup that misses the buckets asks the Bloom filter
+// of each run, newest first, and reads one block of the runs that may
+// hold the element.
+//
+// After a spill, the newest runs of the partition are merged into one for
+// as long as the run before them holds fewer than kSizeRatio times as many
+// records, so run sizes grow geometrically: a partition has a logarithmic
+// number of runs, and each record is rewritten a logarithmic number of
+// times. A merge reads its runs and writes the merged run a block at a
+// time, so it needs little memory however large the runs are.
+//
+// Removing an element that is on disk records it in the partition's
+// removed set, which is applied when a merge reaches its run. Each element
+// is in exactly one place: a bucket, or a run and not removed. Removed
+// elements count against |memory_limit| like those in buckets; when a
+// partition has more of them than the coldest one has in its buckets, all
+// its runs are merged instead of spilling.
+//
+// The capacity is fixed, since the runs are partitioned by it; size it
+// to about a quarter of |memory_limit|. Elements are written as bytes,
+// so T must be trivially copyable. The files are scratch space in
+// |directory|, removed by the destructor. I/O errors are reported by
+// Ok(), and the elements that could not be spilled stay in memory.
+template <typename T, typename Hash = std::hash<T>>
+class HashSetTiered : public HashSetBase<T> {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "HashSetTiered writes elements to disk as bytes");
+
+private:
+  // A run is merged with the newer ones after it unless it holds at least
+  // kSizeRatio times as many records as they do together
+  static constexpr size_t kSizeRatio = 2;
+  // Records read or written at a time by merges and ForEach
+  static constexpr size_t kStreamBlock = 4096;
+  // Records per block read from disk, and between two fences
+  static constexpr size_t kFenceInterval = 64;
+  // Bloom filter bits per element, and probes, for about 1% false
+  // positives
+  static constexpr size_t kBloomBitsPerElement = 10;
+  static constexpr size_t kBloomProbes = 7;
+
+  struct Record {
+    uint64_t hash; // The hash of the element, which runs are sorted by
+    T elem;        // The element
+  };
+
+  class BloomFilter {
+  private:
+    std::vector<uint64_t> bits_;
+
+  public:
+    explicit BloomFilter(size_t elements)
+        : bits_((elements * kBloomBitsPerElement) / 64 + 1) {}
+
+    void Insert(uint64_t hash) {
+      uint64_t h1 = StaticHashMix(hash);
+      uint64_t h2 = (h1 >> 32) | 1;
+      for (size_t i = 0; i < kBloomProbes; i++) {
+        uint64_t bit = (h1 + i * h2) % (64 * bits_.size());
+        bits_[bit / 64] |= uint64_t{1} << (bit % 64);
+      }
+    }
+
+    [[nodiscard]] bool MayContain(uint64_t hash) const {
+      uint64_t h1 = StaticHashMix(hash);
+      uint64_t h2 = (h1 >> 32) | 1;
+      for (size_t i = 0; i < kBloomProbes; i++) {
+        uint64_t bit = (h1 + i * h2) % (64 * bits_.size());
+        if (((bits_[bit / 64] >> (bit % 64)) & 1) == 0) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+
+  struct Run {
+    uint64_t first;               // Its first record in the file
+    size_t count;                 // Its number of records
+    std::vector<uint64_t> fences; // The hash of every kFenceInterval-th
+    BloomFilter bloom;            // The hashes of its records
+  };
+
+  struct Partition {
+    std::mutex mutex;                      // Protects the partition
+    int fd = -1;                           // Its file
+    uint64_t records = 0;                  // Records in the file
+    std::vector<Run> runs;                 // Oldest first
+    std::unordered_set<T, Hash> removed;   // Removed elements of the runs
+    std::atomic<size_t> in_memory{0};      // Elements in its buckets
+    std::atomic<size_t> removed_count{0};  // The size of |removed|
+    std::atomic<uint64_t> last_used{0};    // Clock of its last operation
+  };
+
+  std::string directory_;                     // Holds the partition files
+  std::vector<std::vector<T>> table_;         // The in-memory buckets
+  std::unique_ptr<Partition[]> partitions_;   // Buckets b % count
+  size_t capacity_;                           // The number of buckets
+  size_t partition_count_;                    // The number of partitions
+  size_t memory_limit_;                       // Elements kept in memory
+  std::atomic<size_t> size_{0};               // The number of elements
+  std::atomic<size_t> in_memory_{0};          // Elements in buckets
+  std::atomic<size_t> removed_{0};            // Elements in removed sets
+  std::atomic<uint64_t> clock_{0};            // Orders partition uses
+  std::atomic<size_t> spills_{0};             // Runs written
+  std::atomic<size_t> block_reads_{0};        // Blocks read from disk
+  std::atomic<bool> ok_{true};                // False after an I/O error
+  std::mutex spill_mutex_;                    // Held while spilling
+  Hash hash_;                                 // Maps elements to buckets
+
+public:
+  // Create the partition files in |directory|, creating it if needed.
+  // Check Ok() before use.
+  HashSetTiered(const std::string &directory, size_t memory_limit,
+                size_t initial_capacity = 0, size_t partitions = 64)
+      : directory_(directory),
+        partitions_(new Partition[std::max<size_t>(partitions, 1)]),
+        capacity_(0), partition_count_(std::max<size_t>(partitions, 1)),
+        memory_limit_(memory_limit) {
+    // A multiple of the partition count, so that each partition gets the
+    // same number of buckets
+    size_t capacity = initial_capacity != 0
+                          ? initial_capacity
+                          : std::max<size_t>(memory_limit / 4, 1);
+    capacity_ = (capacity + partition_count_ - 1) / partition_count_ *
+                partition_count_;
+    table_.resize(capacity_);
+
+    if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+      ok_ = false;
+      return;
+    }
+    for (size_t p = 0; p < partition_count_; p++) {
+      partitions_[p].fd =
+          open(PathOf(p).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (partitions_[p].fd < 0) {
+        ok_ = false;
+      }
+    }
+  }
+
+  ~HashSetTiered() override {
+    for (size_t p = 0; p < partition_count_; p++) {
+      if (partitions_[p].fd >= 0) {
+        close(partitions_[p].fd);
+        unlink(PathOf(p).c_str());
+      }
+    }
+    // Only succeeds if the directory held nothing else
+    rmdir(directory_.c_str());
+  }
+
+  HashSetTiered(const HashSetTiered &) = delete;
+  HashSetTiered &operator=(const HashSetTiered &) = delete;
+
+  // Add an element to the hash set
+  bool Add(T elem) final {
+    uint64_t hash = static_cast<uint64_t>(hash_(elem));
+    std::vector<T> &bucket = table_[hash % capacity_];
+    Partition &partition = PartitionOf(hash);
+    {
+      std::scoped_lock<std::mutex> lock(partition.mutex);
+      partition.last_used = clock_++;
+      if (std::find(bucket.begin(), bucket.end(), elem) != bucket.end()) {
+        return false;
+      }
+      if (partition.removed.erase(elem) != 0) {
+        // Still in its run
+        partition.removed_count--;
+        removed_--;
+        size_++;
+        return true;
+      }
+      if (FindOnDisk(partition, hash, elem)) {
+        return false;
+      }
+      bucket.push_back(elem);
+      partition.in_memory++;
+      in_memory_++;
+      size_++;
+    }
+    if (MemoryUsed() > memory_limit_) {
+      SpillColdest();
+    }
+    return true;
+  }
+
+  // Remove an element from the hash set
+  bool Remove(T elem) final {
+    uint64_t hash = static_cast<uint64_t>(hash_(elem));
+    std::vector<T> &bucket = table_[hash % capacity_];
+    Partition &partition = PartitionOf(hash);
+    {
+      std::scoped_lock<std::mutex> lock(partition.mutex);
+      partition.last_used = clock_++;
+      auto it = std::find(bucket.begin(), bucket.end(), elem);
+      if (it != bucket.end()) {
+        *it = bucket.back();
+        bucket.pop_back();
+        partition.in_memory--;
+        in_memory_--;
+        size_--;
+        return true;
+      }
+      if (partition.removed.count(elem) != 0 ||
+          !FindOnDisk(partition, hash, elem)) {
+        return false;
+      }
+      partition.removed.insert(elem);
+      partition.removed_count++;
+      removed_++;
+      size_--;
+    }
+    if (MemoryUsed() > memory_limit_) {
+      SpillColdest();
+    }
+    return true;
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] bool Contains(T elem) final {
+    uint64_t hash = static_cast<uint64_t>(hash_(elem));
+    const std::vector<T> &bucket = table_[hash % capacity_];
+    Partition &partition = PartitionOf(hash);
+    std::scoped_lock<std::mutex> lock(partition.mutex);
+    partition.last_used = clock_++;
+    if (std::find(bucket.begin(), bucket.end(), elem) != bucket.end()) {
+      return true;
+    }
+    return partition.removed.count(elem) == 0 &&
+           FindOnDisk(partition, hash, elem);
+  }
+
+  // Get the size of the hashset
+  [[nodiscard]] size_t Size() const final { return size_.load(); }
+
+  // Call |f| on every element, reading the runs of one partition at a time
+  // in blocks of kStreamBlock records
+  void ForEach(const std::function<void(const T &)> &f) final {
+    std::vector<Record> block;
+    for (size_t p = 0; p < partition_count_; p++) {
+      Partition &partition = partitions_[p];
+      std::scoped_lock<std::mutex> lock(partition.mutex);
+      for (size_t b = p; b < capacity_; b += partition_count_) {
+        for (const T &elem : table_[b]) {
+          f(elem);
+        }
+      }
+      for (const Run &run : partition.runs) {
+        for (size_t begin = 0; begin < run.count; begin += kStreamBlock) {
+          size_t count = std::min(kStreamBlock, run.count - begin);
+          if (!ReadRecords(partition, run.first + begin, count, block)) {
+            break;
+          }
+          for (const Record &record : block) {
+            if (partition.removed.count(record.elem) == 0) {
+              f(record.elem);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Returns false after an I/O error
+  [[nodiscard]] bool Ok() const { return ok_.load(); }
+
+  // Returns the number of elements in memory
+  [[nodiscard]] size_t InMemory() const { return in_memory_.load(); }
+
+  // Returns the number of runs written to disk
+  [[nodiscard]] size_t Spills() const { return spills_.load(); }
+
+  // Returns the number of blocks read from disk by lookups
+  [[nodiscard]] size_t BlockReads() const { return block_reads_.load(); }
+
+private:
+  std::string PathOf(size_t p) const {
+    return directory_ + "/partition-" + std::to_string(p) + ".run";
+  }
+
+  Partition &PartitionOf(uint64_t hash) {
+    return partitions_[(hash % capacity_) % partition_count_];
+  }
+
+  // Returns the elements held in memory, in buckets or removed sets
+  size_t MemoryUsed() const { return in_memory_.load() + removed_.load(); }
+
+  // Reads records [first, first + count) of |partition|'s file
+  bool ReadRecords(const Partition &partition, uint64_t first, size_t count,
+                   std::vector<Record> &records) {
+    records.resize(count);
+    size_t bytes = count * sizeof(Record);
+    auto *data = reinterpret_cast<char *>(records.data());
+    auto offset = static_cast<off_t>(first * sizeof(Record));
+    while (bytes > 0) {
+      ssize_t result = pread(partition.fd, data, bytes, offset);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        ok_ = false;
+        records.clear();
+        return false;
+      }
+      data += result;
+      bytes -= static_cast<size_t>(result);
+      offset += result;
+    }
+    return true;
+  }
+
+  // Writes |records| to |fd| at record |first|
+  bool WriteRecords(int fd, uint64_t first,
+                    const std::vector<Record> &records) {
+    size_t bytes = records.size() * sizeof(Record);
+    const auto *data = reinterpret_cast<const char *>(records.data());
+    auto offset = static_cast<off_t>(first * sizeof(Record));
+    while (bytes > 0) {
+      ssize_t result = pwrite(fd, data, bytes, offset);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        ok_ = false;
+        return false;
+      }
+      data += result;
+      bytes -= static_cast<size_t>(result);
+      offset += result;
+    }
+    return true;
+  }
+
+  // Returns true if |elem| is in a run of |partition|, whose mutex must
+  // be held. Removed elements are not checked.
+  bool FindOnDisk(Partition &partition, uint64_t hash, const T &elem) {
+    std::vector<Record> block;
+    for (auto run = partition.runs.rbegin(); run != partition.runs.rend();
+         run++) {
+      if (!run->bloom.MayContain(hash)) {
+        continue;
+      }
+      // Start at the last block whose first hash is below |hash|, since
+      // equal hashes may straddle two blocks
+      auto fence =
+          std::lower_bound(run->fences.begin(), run->fences.end(), hash);
+      size_t index = static_cast<size_t>(fence - run->fences.begin());
+      index = index == 0 ? 0 : index - 1;
+      for (; index < run->fences.size() && run->fences[index] <= hash;
+           index++) {
+        size_t begin = index * kFenceInterval;
+        size_t count = std::min(kFenceInterval, run->count - begin);
+        block_reads_++;
+        if (!ReadRecords(partition, run->first + begin, count, block)) {
+          return false;
+        }
+        for (const Record &record : block) {
+          if (record.hash == hash && record.elem == elem) {
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  // Spills the least recently used partitions, or applies the largest
+  // removed sets, until a quarter of the memory limit is free. Other
+  // threads carry on meanwhile.
+  void SpillColdest() {
+    std::unique_lock<std::mutex> spill_lock(spill_mutex_, std::try_to_lock);
+    if (!spill_lock.owns_lock()) {
+      return;
+    }
+    while (MemoryUsed() > memory_limit_ / 4 * 3) {
+      size_t coldest = partition_count_;
+      uint64_t oldest = std::numeric_limits<uint64_t>::max();
+      size_t most_removed = partition_count_;
+      size_t removed = 0;
+      for (size_t p = 0; p < partition_count_; p++) {
+        if (partitions_[p].in_memory.load() > 0 &&
+            partitions_[p].last_used.load() < oldest) {
+          coldest = p;
+          oldest = partitions_[p].last_used.load();
+        }
+        if (partitions_[p].removed_count.load() > removed) {
+          most_removed = p;
+          removed = partitions_[p].removed_count.load();
+        }
+      }
+      // Whichever frees more memory
+      if (most_removed != partition_count_ &&
+          (coldest == partition_count_ ||
+           removed > partitions_[coldest].in_memory.load())) {
+        if (!Compact(most_removed)) {
+          return;
+        }
+      } else if (coldest == partition_count_ || !Spill(coldest)) {
+        return;
+      }
+    }
+  }
+
+  // Writes the buckets of partition |p| to a new run. Returns false on
+  // error, leaving the elements in memory.
+  bool Spill(size_t p) {
+    Partition &partition = partitions_[p];
+    std::scoped_lock<std::mutex> lock(partition.mutex);
+    std::vector<Record> records;
+    for (size_t b = p; b < capacity_; b += partition_count_) {
+      for (const T &elem : table_[b]) {
+        Record record{};
+        record.hash = static_cast<uint64_t>(hash_(elem));
+        record.elem = elem;
+        records.push_back(record);
+      }
+    }
+    if (records.empty()) {
+      return true;
+    }
+    std::sort(records.begin(), records.end(),
+              [](const Record &lhs, const Record &rhs) {
+                return lhs.hash < rhs.hash;
+              });
+    if (!WriteRecords(partition.fd, partition.records, records)) {
+      return false;
+    }
+    Run run = NewRun(partition.records, records.size());
+    for (const Record &record : records) {
+      AppendToRun(run, record);
+    }
+    partition.runs.push_back(std::move(run));
+    partition.records += records.size();
+    spills_++;
+
+    for (size_t b = p; b < capacity_; b += partition_count_) {
+      // Swapped rather than cleared, to give the memory back
+      std::vector<T>().swap(table_[b]);
+    }
+    partition.in_memory -= records.size();
+    in_memory_ -= records.size();
+
+    return MergeNewest(p);
+  }
+
+  // Merges the newest runs of partition |p| into one for as long as the
+  // run before them holds fewer than kSizeRatio times as many records.
+  // Its mutex must be held.
+  bool MergeNewest(size_t p) {
+    const std::vector<Run> &runs = partitions_[p].runs;
+    size_t first_run = runs.size() - 1;
+    size_t newer = runs[first_run].count;
+    while (first_run > 0 && runs[first_run - 1].count < kSizeRatio * newer) {
+      first_run--;
+      newer += runs[first_run].count;
+    }
+    return first_run + 1 == runs.size() || Merge(p, first_run);
+  }
+
+  // Merges every run of partition |p|, to empty its removed set
+  bool Compact(size_t p) {
+    std::scoped_lock<std::mutex> lock(partitions_[p].mutex);
+    return partitions_[p].runs.empty() || Merge(p, 0);
+  }
+
+  // Merges the runs of partition |p| from |first_run| on into one, dropping
+  // their removed elements. Its mutex must be held.
+  //
+  // The runs are read, and the merged run written after the last one, a
+  // block at a time. The merged run then replaces them, and is copied
+  // over the space they held. On error before the replacement, the old
+  // runs stay as they were; on error while copying, the merged run stays
+  // after the space.
+  bool Merge(size_t p, size_t first_run) {
+    struct Cursor {
+      uint64_t next;             // The next record to read
+      uint64_t end;              // The end of the run
+      std::vector<Record> block; // Records read, not all merged yet
+      size_t index;              // The next record of |block| to merge
+    };
+
+    Partition &partition = partitions_[p];
+    std::vector<Run> &runs = partition.runs;
+    std::vector<Cursor> cursors;
+    size_t inputs = 0;
+    for (size_t r = first_run; r < runs.size(); r++) {
+      cursors.push_back(
+          Cursor{runs[r].first, runs[r].first + runs[r].count, {}, 0});
+      inputs += runs[r].count;
+    }
+    uint64_t begin = runs[first_run].first;
+    uint64_t end = partition.records;
+
+    Run merged = NewRun(end, inputs);
+    std::vector<Record> out;
+    std::vector<T> dropped;
+    bool ok = true;
+    while (ok) {
+      Cursor *min = nullptr;
+      for (Cursor &cursor : cursors) {
+        if (cursor.index == cursor.block.size()) {
+          if (cursor.next == cursor.end) {
+            continue;
+          }
+          size_t count = static_cast<size_t>(
+              std::min<uint64_t>(kStreamBlock, cursor.end - cursor.next));
+          if (!ReadRecords(partition, cursor.next, count, cursor.block)) {
+            ok = false;
+            break;
+          }
+          cursor.next += count;
+          cursor.index = 0;
+        }
+        if (min == nullptr ||
+            cursor.block[cursor.index].hash < min->block[min->index].hash) {
+          min = &cursor;
+        }
+      }
+      if (!ok || min == nullptr) {
+        break;
+      }
+      const Record &record = min->block[min->index++];
+      if (partition.removed.count(record.elem) != 0) {
+        dropped.push_back(record.elem);
+        continue;
+      }
+      AppendToRun(merged, record);
+      out.push_back(record);
+      if (out.size() == kStreamBlock) {
+        ok = WriteRecords(partition.fd, end + merged.count - out.size(), out);
+        out.clear();
+      }
+    }
+    if (ok && !out.empty()) {
+      ok = WriteRecords(partition.fd, end + merged.count - out.size(), out);
+    }
+    if (!ok) {
+      Truncate(partition, end);
+      return false;
+    }
+
+    runs.erase(runs.begin() + static_cast<std::ptrdiff_t>(first_run),
+               runs.end());
+    for (const T &elem : dropped) {
+      partition.removed.erase(elem);
+    }
+    partition.removed_count -= dropped.size();
+    removed_ -= dropped.size();
+    if (merged.count == 0) {
+      Truncate(partition, begin);
+      return true;
+    }
+    runs.push_back(std::move(merged));
+    partition.records = end + runs.back().count;
+
+    // Copy the merged run down, which it fits in without overlapping
+    std::vector<Record> block;
+    for (uint64_t done = 0; done < runs.back().count; done += kStreamBlock) {
+      size_t count = static_cast<size_t>(
+          std::min<uint64_t>(kStreamBlock, runs.back().count - done));
+      if (!ReadRecords(partition, end + done, count, block) ||
+          !WriteRecords(partition.fd, begin + done, block)) {
+        return false;
+      }
+    }
+    runs.back().first = begin;
+    Truncate(partition, begin + runs.back().count);
+    return true;
+  }
+
+  // Drops the records of |partition|'s file from |records| on
+  void Truncate(Partition &partition, uint64_t records) {
+    partition.records = records;
+    if (ftruncate(partition.fd,
+                  static_cast<off_t>(records * sizeof(Record))) != 0) {
+      ok_ = false;
+    }
+  }
+
+  // Returns an empty run at record |first|, for up to |capacity| records
+  static Run NewRun(uint64_t first, size_t capacity) {
+    return Run{first, 0, {}, BloomFilter(capacity)};
+  }
+
+  // Indexes |record|, the next record of |run| in hash order
+  static void AppendToRun(Run &run, const Record &record) {
+    if (run.count % kFenceInterval == 0) {
+      run.fences.push_back(record.hash);
+    }
+    run.bloom.Insert(record.hash);
+    run.count++;
+  }
+};
+
+#endif // HASH_SET_TIERED_H
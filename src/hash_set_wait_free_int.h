@@ -0,0 +1,252 @@
+#ifndef HASH_SET_WAIT_FREE_INT_H
+#define HASH_SET_WAIT_FREE_INT_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+#include "src/hash_set_base.h"
+
+// A fixed-capacity open-addressing hash set of integers up to 32 bits,
+// whose Contains is wait-free: it reads at most kProbeLimit + kStashSize
+// slots and never retries, so it has a hard bound on its running time.
+// Add and Remove are lock-free.
+//
+// An element lives in one of the kProbeLimit slots following its home
+// slot, or when those are taken, in a small stash shared by all elements.
+// The set does not grow: an Add that finds no free slot in either place
+// returns false and is counted in Overflows(). Size the capacity to about
+// twice the expected number of elements.
+//
+// Each slot is a single 64-bit word holding the key, a state and a
+// version, so that it is read and updated atomically. Add claims a free
+// slot as kInserting, then settles the insertions of that key in flight:
+// the first one in probe order wins and becomes kMember, unless the key
+// already has a member, and the later ones are marked kCollided. Any
+// thread that finds an insertion in flight helps settle it, so a stalled
+// thread does not block other inserts of the same key. The version is
+// bumped whenever a slot is claimed, so an Add can tell its own claim
+// from a later one in the same slot.
+template <typename T> class HashSetWaitFreeInt : public HashSetBase<T> {
+  static_assert(std::is_integral_v<T> && sizeof(T) <= 4,
+                "HashSetWaitFreeInt only supports integers up to 32 bits");
+
+private:
+  // Slots after the home slot where an element may live
+  static constexpr size_t kProbeLimit = 16;
+  // Slots of the stash, for elements whose probe window is full
+  static constexpr size_t kStashSize = 16;
+  // Length of the probe sequence of an element
+  static constexpr size_t kProbeLength = kProbeLimit + kStashSize;
+  // Returned by Settle when the key has no member
+  static constexpr size_t kNone = SIZE_MAX;
+
+  // Low bits of a slot word; the key is in the upper 32 bits, and the
+  // version in between
+  static constexpr uint64_t kEmpty = 0;     // Free to claim
+  static constexpr uint64_t kInserting = 1; // Claimed by an Add in flight
+  static constexpr uint64_t kMember = 2;    // Holds an element of the set
+  static constexpr uint64_t kCollided = 3;  // Lost to another insertion
+  static constexpr uint64_t kStateMask = 3;
+  static constexpr uint64_t kVersionMask = 0xFFFFFFFC;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> slots_; // Table, then stash
+  size_t capacity_;                                // Slots before the stash
+  std::atomic<size_t> size_;                       // The number of elements
+  std::atomic<size_t> overflows_;                  // Adds without a slot
+
+public:
+  // Create a set with |capacity| slots, plus the stash
+  explicit HashSetWaitFreeInt(size_t capacity)
+      : capacity_(capacity < kProbeLimit ? kProbeLimit : capacity), size_(0),
+        overflows_(0) {
+    slots_ = std::make_unique<std::atomic<uint64_t>[]>(capacity_ + kStashSize);
+    for (size_t i = 0; i < capacity_ + kStashSize; i++) {
+      slots_[i].store(kEmpty);
+    }
+  }
+
+  // Add an element to the hash set
+  bool Add(T elem) final {
+    uint64_t key = KeyOf(elem);
+    size_t home = Home(elem);
+    while (true) {
+      if (Settle(home, key) != kNone) {
+        return false;
+      }
+
+      // Claim the first free slot in probe order
+      size_t index = kNone;
+      uint64_t claimed = 0;
+      for (size_t position = 0; position < kProbeLength; position++) {
+        size_t i = SlotIndex(home, position);
+        uint64_t word = slots_[i].load();
+        if ((word & kStateMask) != kEmpty) {
+          continue;
+        }
+        claimed = (key << 32) | (((word & kVersionMask) + 4) & kVersionMask) |
+                  kInserting;
+        if (slots_[i].compare_exchange_strong(word, claimed)) {
+          index = i;
+          break;
+        }
+      }
+      if (index == kNone) {
+        overflows_.fetch_add(1);
+        return false;
+      }
+
+      size_t member = Settle(home, key);
+      // The claim is still in flight only if the key has another member
+      uint64_t current = claimed;
+      if (slots_[index].compare_exchange_strong(current, Emptied(claimed))) {
+        return false;
+      }
+      if (current != WithState(claimed, kCollided)) {
+        // The claim was promoted, and may have been removed since
+        return true;
+      }
+      // Collided slots are only freed by the thread that claimed them
+      slots_[index].store(Emptied(claimed));
+      if (member != kNone) {
+        return false;
+      }
+      // The insertion that beat ours was removed again, so retry
+    }
+  }
+
+  // Remove an element from the hashset
+  bool Remove(T elem) final {
+    uint64_t key = KeyOf(elem);
+    size_t home = Home(elem);
+    for (size_t position = 0; position < kProbeLength; position++) {
+      size_t i = SlotIndex(home, position);
+      uint64_t word = slots_[i].load();
+      if (IsMember(word, key)) {
+        // If this fails, a concurrent Remove took the element first
+        if (!slots_[i].compare_exchange_strong(word, Emptied(word))) {
+          return false;
+        }
+        size_.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Check if an element is contained in the hashset. This never waits
+  // for or retries after another thread.
+  [[nodiscard]] bool Contains(T elem) final {
+    uint64_t key = KeyOf(elem);
+    size_t home = Home(elem);
+    for (size_t position = 0; position < kProbeLength; position++) {
+      if (IsMember(slots_[SlotIndex(home, position)].load(), key)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Get the size of the hashset
+  [[nodiscard]] size_t Size() const final { return size_.load(); }
+
+  // Call |f| on every element. Insertions that are not settled yet are
+  // not visited.
+  void ForEach(const std::function<void(const T &)> &f) final {
+    for (size_t i = 0; i < capacity_ + kStashSize; i++) {
+      uint64_t word = slots_[i].load();
+      if ((word & kStateMask) == kMember) {
+        f(static_cast<T>(static_cast<std::make_unsigned_t<T>>(word >> 32)));
+      }
+    }
+  }
+
+  // Returns the number of Adds that failed because no slot was free
+  [[nodiscard]] size_t Overflows() const { return overflows_.load(); }
+
+private:
+  static uint64_t KeyOf(T elem) {
+    return static_cast<uint64_t>(static_cast<std::make_unsigned_t<T>>(elem));
+  }
+
+  static uint64_t WithState(uint64_t word, uint64_t state) {
+    return (word & ~kStateMask) | state;
+  }
+
+  // An empty slot keeps its version, so that the next claim bumps it
+  static uint64_t Emptied(uint64_t word) { return word & kVersionMask; }
+
+  static bool IsMember(uint64_t word, uint64_t key) {
+    return (word & kStateMask) == kMember && (word >> 32) == key;
+  }
+
+  size_t Home(T elem) const { return std::hash<T>()(elem) % capacity_; }
+
+  // Returns the slot at |position| in the probe sequence from |home|
+  size_t SlotIndex(size_t home, size_t position) const {
+    if (position < kProbeLimit) {
+      return (home + position) % capacity_;
+    }
+    return capacity_ + position - kProbeLimit;
+  }
+
+  // Settles the insertions of |key| in flight. Returns the index of a
+  // member slot of |key| as soon as one is seen, or kNone once |key| has
+  // neither a member nor an insertion in flight.
+  size_t Settle(size_t home, uint64_t key) {
+    while (true) {
+      size_t first = kNone;
+      size_t first_position = 0;
+      uint64_t first_word = 0;
+      for (size_t position = 0; position < kProbeLength; position++) {
+        size_t i = SlotIndex(home, position);
+        uint64_t word = slots_[i].load();
+        if ((word >> 32) != key) {
+          continue;
+        }
+        if ((word & kStateMask) == kMember) {
+          return i;
+        }
+        if ((word & kStateMask) == kInserting && first == kNone) {
+          first = i;
+          first_position = position;
+          first_word = word;
+        }
+      }
+      if (first == kNone) {
+        return kNone;
+      }
+
+      // The first insertion in probe order wins over the later ones. A
+      // member, or an insertion before the first, that appeared since the
+      // scan above was promoted or claimed behind it, so scan again.
+      bool changed = false;
+      for (size_t position = 0; position < kProbeLength && !changed;
+           position++) {
+        size_t i = SlotIndex(home, position);
+        uint64_t word = slots_[i].load();
+        if (i == first || (word >> 32) != key) {
+          continue;
+        }
+        uint64_t state = word & kStateMask;
+        if (state == kMember ||
+            (state == kInserting && position < first_position)) {
+          changed = true;
+        } else if (state == kInserting &&
+                   !slots_[i].compare_exchange_strong(
+                       word, WithState(word, kCollided))) {
+          changed = true;
+        }
+      }
+      // If this fails, a new insertion earlier in probe order beat it
+      if (!changed && slots_[first].compare_exchange_strong(
+                          first_word, WithState(first_word, kMember))) {
+        size_.fetch_add(1);
+      }
+    }
+  }
+};
+
+#endif // HASH_SET_WAIT_FREE_INT_H
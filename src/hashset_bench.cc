@@ -0,0 +1,49 @@
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "src/benchmark.h"
+#include "src/hash_set_factory.h"
+
+namespace {
+
+// Creates the hash sets through the registry, by the name given in --impl
+struct RegistryFactory {
+  template <typename T>
+  static std::unique_ptr<HashSetBase<T>>
+  Make(const benchmark::BenchmarkOptions &options) {
+    HashSetOptions hash_set_options;
+    hash_set_options.trace_path = options.trace_path;
+    auto hash_set = MakeHashSet<T>(options.implementation,
+                                   options.initial_capacity, hash_set_options);
+    // The implementation was checked by main, so only the trace can fail
+    if (hash_set == nullptr) {
+      std::cerr << "Could not create the trace file " << options.trace_path
+                << std::endl;
+    }
+    return hash_set;
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  // Check the implementation up front, so that the factory never fails
+  benchmark::BenchmarkOptions options;
+  if (!benchmark::ParseOptions(argc, argv, options)) {
+    return 1;
+  }
+  if (HashSetRegistry<int>::Find(options.implementation) == nullptr) {
+    std::cerr << argv[0] << ": --impl must be one of "
+              << HashSetRegistry<int>::Names() << std::endl;
+    return 1;
+  }
+  if (!IsThreadSafeHashSet<int>(options.implementation) &&
+      (options.num_threads != 1 || options.oversubscription != 0)) {
+    std::cerr << argv[0] << ": " << options.implementation
+              << " can only be run with one thread" << std::endl;
+    return 1;
+  }
+  std::cout << "Implementation: " << options.implementation << std::endl;
+  return benchmark::RunBenchmarkWith<RegistryFactory>(argc, argv);
+}
@@ -0,0 +1,89 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace benchmark {
+
+// A log-linear histogram of latencies in nanoseconds.
+//
+// Values are grouped by their highest set bit, and every power of two is
+// split into 16 linear sub-buckets, so the relative error of a reported
+// percentile is below 1/16 whatever the magnitude. Recording is a couple
+// of bit operations, so each worker thread can keep its own histogram and
+// they are merged at the end.
+class LatencyHistogram {
+private:
+  static constexpr size_t kSubBucketBits = 4;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  static constexpr size_t kBuckets = 64 * kSubBuckets;
+
+  std::array<uint64_t, kBuckets> counts_{}; // Number of values per bucket
+  uint64_t total_ = 0;                      // Number of recorded values
+  uint64_t max_ = 0;                        // Largest recorded value
+
+  static size_t IndexOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return static_cast<size_t>(value);
+    }
+    size_t magnitude = 63 - static_cast<size_t>(__builtin_clzll(value));
+    size_t shift = magnitude - kSubBucketBits;
+    size_t sub_bucket = static_cast<size_t>(value >> shift) - kSubBuckets;
+    return (shift + 1) * kSubBuckets + sub_bucket;
+  }
+
+  // The largest value that maps to bucket |index|
+  static uint64_t UpperBoundOf(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    size_t shift = index / kSubBuckets - 1;
+    uint64_t sub_bucket = index % kSubBuckets + kSubBuckets;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+public:
+  void Record(uint64_t nanos) {
+    counts_[IndexOf(nanos)]++;
+    total_++;
+    max_ = std::max(max_, nanos);
+  }
+
+  void Merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < kBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  // Returns the value below which |percentile| percent of the recorded
+  // values fall, rounded up to its bucket.
+  [[nodiscard]] uint64_t Percentile(double percentile) const {
+    if (total_ == 0) {
+      return 0;
+    }
+    auto rank = static_cast<uint64_t>(percentile / 100.0 *
+                                      static_cast<double>(total_ - 1)) +
+                1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(UpperBoundOf(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  [[nodiscard]] uint64_t Count() const { return total_; }
+
+  [[nodiscard]] uint64_t Max() const { return max_; }
+};
+
+} // namespace benchmark
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,106 @@
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The CPUs of each NUMA node, as listed in /sys/devices/system/node. On
+// other systems, or if the listing is missing, all CPUs are one node.
+class NumaTopology {
+private:
+  std::vector<std::vector<size_t>> node_cpus_; // The CPUs of each node
+  std::vector<size_t> cpu_nodes_;              // The node of each CPU
+
+public:
+  NumaTopology() {
+#ifdef __linux__
+    for (size_t node = 0;; node++) {
+      std::ifstream file("/sys/devices/system/node/node" +
+                         std::to_string(node) + "/cpulist");
+      std::string list;
+      if (!std::getline(file, list)) {
+        break;
+      }
+      node_cpus_.push_back(ParseCpuList(list));
+      for (size_t cpu : node_cpus_.back()) {
+        if (cpu_nodes_.size() <= cpu) {
+          cpu_nodes_.resize(cpu + 1, 0);
+        }
+        cpu_nodes_[cpu] = node;
+      }
+    }
+#endif
+    if (node_cpus_.empty()) {
+      node_cpus_.emplace_back();
+    }
+  }
+
+  // Returns the number of nodes, at least 1
+  [[nodiscard]] size_t Nodes() const { return node_cpus_.size(); }
+
+  // Returns the CPUs of |node|, which is empty if they are not known
+  [[nodiscard]] const std::vector<size_t> &CpusOf(size_t node) const {
+    return node_cpus_[node];
+  }
+
+  // Returns the node of the CPU the calling thread runs on
+  [[nodiscard]] size_t CurrentNode() const {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes_.size()) {
+      return cpu_nodes_[static_cast<size_t>(cpu)];
+    }
+#endif
+    return 0;
+  }
+
+  // Restricts the calling thread to the CPUs of |node|. Returns false if
+  // they are not known or the thread may not run there.
+  bool PinToNode(size_t node) const {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (size_t cpu : node_cpus_[node]) {
+      if (cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    return !node_cpus_[node].empty() &&
+           sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+  }
+
+private:
+  // Parses a list such as "0-3,8,10-11"
+  static std::vector<size_t> ParseCpuList(const std::string &list) {
+    std::vector<size_t> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+      if (range.empty()) {
+        continue;
+      }
+      size_t dash = range.find('-');
+      size_t first = std::stoul(range.substr(0, dash));
+      size_t last = dash == std::string::npos
+                        ? first
+                        : std::stoul(range.substr(dash + 1));
+      for (size_t cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+};
+
+#endif // NUMA_TOPOLOGY_H
@@ -0,0 +1,337 @@
+#include "src/partition.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include "src/hash_set_striped.h"
+
+namespace partition {
+
+namespace {
+
+// Reads exactly |bytes| bytes, and returns false on error or end of file
+bool ReadAll(int fd, void *data, size_t bytes) {
+  auto *bytes_left = static_cast<char *>(data);
+  while (bytes > 0) {
+    ssize_t result = read(fd, bytes_left, bytes);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    bytes_left += result;
+    bytes -= static_cast<size_t>(result);
+  }
+  return true;
+}
+
+// Writes exactly |bytes| bytes, and returns false on error
+bool WriteAll(int fd, const void *data, size_t bytes) {
+  const auto *bytes_left = static_cast<const char *>(data);
+  while (bytes > 0) {
+    ssize_t result = send(fd, bytes_left, bytes, MSG_NOSIGNAL);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    bytes_left += result;
+    bytes -= static_cast<size_t>(result);
+  }
+  return true;
+}
+
+// Fills |address| with |path|, and returns false if it is too long
+bool MakeAddress(const std::string &path, sockaddr_un &address) {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// Answers the batches of one client until it disconnects
+void ServeConnection(int fd, HashSetStriped<uint64_t> &hash_set) {
+  std::vector<Request> requests;
+  std::vector<uint64_t> results;
+  BatchHeader header{};
+  while (ReadAll(fd, &header, sizeof(header)) && header.count <= kMaxBatch) {
+    requests.resize(header.count);
+    if (!ReadAll(fd, requests.data(), header.count * sizeof(Request))) {
+      break;
+    }
+
+    if (header.count == 1 && requests[0].operation == Operation::kList) {
+      std::vector<uint64_t> keys;
+      hash_set.ForEach([&keys](const uint64_t &key) { keys.push_back(key); });
+      uint64_t count = keys.size();
+      if (!WriteAll(fd, &count, sizeof(count)) ||
+          !WriteAll(fd, keys.data(), keys.size() * sizeof(uint64_t))) {
+        break;
+      }
+      continue;
+    }
+
+    results.resize(header.count);
+    for (size_t i = 0; i < header.count; i++) {
+      const Request &request = requests[i];
+      switch (request.operation) {
+      case Operation::kAdd:
+        results[i] = hash_set.Add(request.key) ? 1 : 0;
+        break;
+      case Operation::kRemove:
+        results[i] = hash_set.Remove(request.key) ? 1 : 0;
+        break;
+      case Operation::kContains:
+        results[i] = hash_set.Contains(request.key) ? 1 : 0;
+        break;
+      case Operation::kSize:
+        results[i] = hash_set.Size();
+        break;
+      case Operation::kList:
+        // Only allowed alone in its batch
+        results[i] = 0;
+        break;
+      }
+    }
+    if (!WriteAll(fd, results.data(), results.size() * sizeof(uint64_t))) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+// Listens on |path|, and returns the socket or -1 on error
+int Listen(const std::string &path) {
+  sockaddr_un address{};
+  if (!MakeAddress(path, address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+          0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Accepts connections on |listen_fd| forever
+void AcceptLoop(int listen_fd, size_t initial_capacity) {
+  // Connection threads are detached, so the set lives as long as the
+  // process
+  auto *hash_set = new HashSetStriped<uint64_t>(initial_capacity);
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return;
+    }
+    std::thread(ServeConnection, fd, std::ref(*hash_set)).detach();
+  }
+}
+
+// The connections the calling thread holds, one entry per set it used.
+// They are closed when the thread exits.
+class ThreadConnections {
+private:
+  struct Lease {
+    uint64_t set_id;                     // The set they belong to
+    std::weak_ptr<ConnectionPool> pool;  // Expired once the set is gone
+    Connections *connections;            // Owned by |pool|
+  };
+
+  std::vector<Lease> leases_; // At most one per set
+
+public:
+  ~ThreadConnections() {
+    for (const Lease &lease : leases_) {
+      if (auto pool = lease.pool.lock()) {
+        pool->Release(lease.connections);
+      }
+    }
+  }
+
+  static ThreadConnections &Get() {
+    thread_local ThreadConnections connections;
+    return connections;
+  }
+
+  // Returns the connections for |set_id|, or nullptr on first use
+  Connections *Find(uint64_t set_id) const {
+    for (const Lease &lease : leases_) {
+      if (lease.set_id == set_id) {
+        return lease.connections;
+      }
+    }
+    return nullptr;
+  }
+
+  // Records |connections| for |set_id|, dropping the leases of sets
+  // destroyed since
+  void Add(uint64_t set_id, const std::shared_ptr<ConnectionPool> &pool,
+           Connections *connections) {
+    leases_.erase(std::remove_if(leases_.begin(), leases_.end(),
+                                 [](const Lease &lease) {
+                                   return lease.pool.expired();
+                                 }),
+                  leases_.end());
+    leases_.push_back(Lease{set_id, pool, connections});
+  }
+};
+
+} // namespace
+
+Connection::Connection(const std::string &path) : fd_(-1) {
+  sockaddr_un address{};
+  if (!MakeAddress(path, address)) {
+    return;
+  }
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ >= 0 && connect(fd_, reinterpret_cast<sockaddr *>(&address),
+                          sizeof(address)) != 0) {
+    Close();
+  }
+}
+
+Connection::~Connection() { Close(); }
+
+bool Connection::Send(const Request *requests, uint32_t count) {
+  BatchHeader header{count, 0};
+  if (fd_ < 0 || count > kMaxBatch || !WriteAll(fd_, &header, sizeof(header)) ||
+      !WriteAll(fd_, requests, count * sizeof(Request))) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool Connection::Receive(uint64_t *results, uint32_t count) {
+  if (fd_ < 0 || !ReadAll(fd_, results, count * sizeof(uint64_t))) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool Connection::List(std::vector<uint64_t> &keys) {
+  Request request{0, Operation::kList, {}};
+  uint64_t count = 0;
+  if (!Send(&request, 1) || !Receive(&count, 1)) {
+    return false;
+  }
+  keys.resize(count);
+  if (!ReadAll(fd_, keys.data(), count * sizeof(uint64_t))) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void Connection::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+Connections &ConnectionPool::Of(uint64_t set_id,
+                                const std::shared_ptr<ConnectionPool> &pool) {
+  ThreadConnections &thread_connections = ThreadConnections::Get();
+  Connections *connections = thread_connections.Find(set_id);
+  if (connections == nullptr) {
+    {
+      std::scoped_lock<std::mutex> lock(pool->mutex_);
+      pool->threads_.push_back(
+          std::make_unique<Connections>(pool->servers_));
+      connections = pool->threads_.back().get();
+    }
+    thread_connections.Add(set_id, pool, connections);
+  }
+  return *connections;
+}
+
+void ConnectionPool::Release(const Connections *connections) {
+  std::scoped_lock<std::mutex> lock(mutex_);
+  threads_.erase(std::remove_if(threads_.begin(), threads_.end(),
+                                [&](const auto &thread) {
+                                  return thread.get() == connections;
+                                }),
+                 threads_.end());
+}
+
+void Serve(const std::string &path, size_t initial_capacity) {
+  int listen_fd = Listen(path);
+  if (listen_fd >= 0) {
+    AcceptLoop(listen_fd, initial_capacity);
+    close(listen_fd);
+  }
+}
+
+pid_t SpawnServer(const std::string &path, size_t initial_capacity) {
+  // The child reports over a pipe once it listens, or closes it on error
+  int ready[2];
+  if (pipe(ready) != 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(ready[0]);
+    int listen_fd = Listen(path);
+    if (listen_fd < 0) {
+      _exit(1);
+    }
+    // A pipe, so write rather than WriteAll, which sends on a socket
+    char byte = 1;
+    if (write(ready[1], &byte, 1) != 1) {
+      _exit(1);
+    }
+    close(ready[1]);
+    AcceptLoop(listen_fd, initial_capacity);
+    _exit(1);
+  }
+  close(ready[1]);
+  char byte = 0;
+  bool listening = pid > 0 && ReadAll(ready[0], &byte, 1);
+  close(ready[0]);
+  if (!listening) {
+    if (pid > 0) {
+      waitpid(pid, nullptr, 0);
+    }
+    return -1;
+  }
+  return pid;
+}
+
+void StopServer(pid_t pid, const std::string &path) {
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+  unlink(path.c_str());
+}
+
+uint64_t NextSetId() {
+  static std::atomic<uint64_t> next_id{1};
+  return next_id.fetch_add(1);
+}
+
+} // namespace partition
@@ -0,0 +1,119 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The wire protocol between PartitionedHashSet and its partition servers,
+// over Unix domain stream sockets.
+//
+// A client sends batches of requests, each a BatchHeader followed by
+// |count| Requests, and may send several batches before reading any
+// reply. The server answers every batch, in order, with |count| uint64_t
+// results in the order of the requests: 1 or 0 for kAdd, kRemove and
+// kContains, and the size of the partition for kSize. A kList request
+// must be alone in its batch, and is answered with the number of keys
+// followed by the keys. Everything is in the native byte order, since
+// both ends are on the same host.
+namespace partition {
+
+enum class Operation : uint8_t {
+  kAdd = 0,
+  kRemove = 1,
+  kContains = 2,
+  kSize = 3,
+  kList = 4,
+};
+
+struct Request {
+  uint64_t key;         // The key, ignored by kSize and kList
+  Operation operation;  // What to do with the key
+  uint8_t reserved[7];  // Always 0
+};
+static_assert(sizeof(Request) == 16, "Requests are sent as-is");
+
+struct BatchHeader {
+  uint32_t count;    // The number of requests that follow
+  uint32_t reserved; // Always 0
+};
+
+// The largest batch a server accepts
+constexpr uint32_t kMaxBatch = 1 << 16;
+
+// A client's connection to one partition server
+class Connection {
+private:
+  int fd_; // The connected socket, or -1 on error
+
+public:
+  // Connects to the server listening on |path|
+  explicit Connection(const std::string &path);
+  ~Connection();
+
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  // Returns false if the connection failed or broke
+  [[nodiscard]] bool Ok() const { return fd_ >= 0; }
+
+  // Sends a batch of |count| requests, and returns false on error
+  bool Send(const Request *requests, uint32_t count);
+
+  // Reads the |count| results of the oldest unanswered batch
+  bool Receive(uint64_t *results, uint32_t count);
+
+  // Sends a kList request and reads the keys of the partition
+  bool List(std::vector<uint64_t> &keys);
+
+private:
+  void Close();
+};
+
+// One connection per server, each nullptr until first used
+using Connections = std::vector<std::unique_ptr<Connection>>;
+
+// The connections of the threads using one PartitionedHashSet. Threads
+// only keep a weak_ptr to it and close their connections when they exit,
+// so threads that come and go do not leak sockets. The connections of
+// threads still running are closed with the pool.
+class ConnectionPool {
+private:
+  std::mutex mutex_;                                  // Protects threads_
+  std::vector<std::unique_ptr<Connections>> threads_; // One per thread
+  size_t servers_;                                    // Connections each
+
+public:
+  explicit ConnectionPool(size_t servers) : servers_(servers) {}
+
+  // Returns the calling thread's connections for the set |set_id|,
+  // creating them in |pool| on first use
+  static Connections &Of(uint64_t set_id,
+                         const std::shared_ptr<ConnectionPool> &pool);
+
+  // Closes the |connections| of a thread that exited
+  void Release(const Connections *connections);
+};
+
+// Serves a HashSetStriped<uint64_t> on |path| with a thread per
+// connection. Only returns if the socket cannot be set up.
+void Serve(const std::string &path, size_t initial_capacity);
+
+// Forks a process that serves on |path|, and waits until it accepts
+// connections. Returns its pid, or -1 on error.
+pid_t SpawnServer(const std::string &path, size_t initial_capacity);
+
+// Terminates a server started by SpawnServer, and removes its socket
+void StopServer(pid_t pid, const std::string &path);
+
+// Returns a new id for a PartitionedHashSet, to key per-thread caches
+uint64_t NextSetId();
+
+} // namespace partition
+
+#endif // PARTITION_H
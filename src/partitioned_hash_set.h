@@ -0,0 +1,257 @@
+#ifndef PARTITIONED_HASH_SET_H
+#define PARTITIONED_HASH_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/hash_set_static.h"
+#include "src/partition.h"
+
+// A hash set whose elements are spread over several server processes, each
+// holding a HashSetStriped of its partition of the key space, reached over
+// Unix domain sockets. Start the servers with partition::SpawnServer, or
+// partition::Serve in a process of their own.
+//
+// An element belongs to partition StaticHashMix(hash) % number of servers.
+// Add, Remove and Contains take one round trip each. The batch methods
+// group the elements by partition, send them in batches of up to
+// |max_batch| requests, and keep up to |pipeline_depth| batches in flight
+// per server before reading the oldest replies, so that the servers work
+// while the replies of earlier batches travel back. At most kMaxInFlight
+// requests are in flight per server, so that neither end blocks sending
+// while the other does.
+//
+// Each thread has its own connections, opened on first use, reopened
+// after an error, and closed when the thread exits or the set is
+// destroyed. A request that fails counts in Errors() and returns
+// false, or 0 for Size.
+template <typename T, typename Hash = std::hash<T>>
+class PartitionedHashSet : public HashSetBase<T> {
+  static_assert(std::is_integral_v<T>,
+                "PartitionedHashSet sends elements as 64-bit integers");
+
+private:
+  using Connections = partition::Connections;
+
+  // Requests sent but not answered yet, per server. The server blocks
+  // writing replies once they fill its socket buffer, and stops reading
+  // requests, so the requests and replies in flight must fit in the
+  // buffers whatever max_batch and pipeline_depth are. 64 KiB of them is
+  // well under the default buffers of Unix domain sockets.
+  static constexpr size_t kMaxInFlight =
+      (64 * 1024) / (sizeof(partition::Request) + sizeof(uint64_t));
+
+  std::vector<std::string> paths_;              // The socket of each server
+  size_t max_batch_;                            // Requests per batch
+  size_t in_flight_;                            // Unanswered requests
+  uint64_t id_;                                 // Keys the thread cache
+  Hash hash_;                                   // Hashes the elements
+  std::shared_ptr<partition::ConnectionPool> connections_; // Per thread
+  mutable std::atomic<size_t> errors_;          // Failed requests
+
+public:
+  // Connect to the servers listening on |paths|. Batches, and the
+  // max_batch * pipeline_depth requests in flight, are capped to
+  // kMaxInFlight requests.
+  explicit PartitionedHashSet(std::vector<std::string> paths,
+                              size_t max_batch = 256,
+                              size_t pipeline_depth = 4)
+      : paths_(std::move(paths)),
+        max_batch_(std::clamp<size_t>(max_batch, 1, kMaxInFlight)),
+        in_flight_(std::clamp<size_t>(
+            max_batch_ * std::max<size_t>(pipeline_depth, 1), max_batch_,
+            kMaxInFlight)),
+        id_(partition::NextSetId()),
+        connections_(
+            std::make_shared<partition::ConnectionPool>(paths_.size())),
+        errors_(0) {}
+
+  // Add an element to the hash set
+  bool Add(T elem) final { return Single(partition::Operation::kAdd, elem); }
+
+  // Remove an element from the hash set
+  bool Remove(T elem) final {
+    return Single(partition::Operation::kRemove, elem);
+  }
+
+  // Check if an element is contained in the hashset
+  [[nodiscard]] bool Contains(T elem) final {
+    return Single(partition::Operation::kContains, elem);
+  }
+
+  // Get the size of the hashset, summed over the servers in one round trip
+  [[nodiscard]] size_t Size() const final {
+    Connections &connections = ThreadConnectionsOf();
+    partition::Request request{0, partition::Operation::kSize, {}};
+    std::vector<bool> sent(paths_.size());
+    for (size_t p = 0; p < paths_.size(); p++) {
+      sent[p] = Connect(connections, p) && connections[p]->Send(&request, 1);
+    }
+    size_t size = 0;
+    for (size_t p = 0; p < paths_.size(); p++) {
+      uint64_t result = 0;
+      if (sent[p] && connections[p]->Receive(&result, 1)) {
+        size += static_cast<size_t>(result);
+      } else {
+        errors_++;
+      }
+    }
+    return size;
+  }
+
+  // Call |f| on every element, fetching the partitions one at a time
+  void ForEach(const std::function<void(const T &)> &f) final {
+    Connections &connections = ThreadConnectionsOf();
+    std::vector<uint64_t> keys;
+    for (size_t p = 0; p < paths_.size(); p++) {
+      if (!Connect(connections, p) || !connections[p]->List(keys)) {
+        errors_++;
+        continue;
+      }
+      for (uint64_t key : keys) {
+        f(static_cast<T>(key));
+      }
+    }
+  }
+
+  // Add |elems|, and return the number that were absent
+  size_t AddBatch(const std::vector<T> &elems) {
+    return Count(Run(partition::Operation::kAdd, elems));
+  }
+
+  // Remove |elems|, and return the number that were present
+  size_t RemoveBatch(const std::vector<T> &elems) {
+    return Count(Run(partition::Operation::kRemove, elems));
+  }
+
+  // Check which of |elems| are contained in the hashset
+  [[nodiscard]] std::vector<bool> ContainsBatch(const std::vector<T> &elems) {
+    return Run(partition::Operation::kContains, elems);
+  }
+
+  // Returns the number of servers
+  [[nodiscard]] size_t Partitions() const { return paths_.size(); }
+
+  // Returns the number of requests that failed
+  [[nodiscard]] size_t Errors() const { return errors_.load(); }
+
+private:
+  size_t PartitionOf(T elem) const {
+    return static_cast<size_t>(
+        StaticHashMix(static_cast<uint64_t>(hash_(elem))) % paths_.size());
+  }
+
+  static size_t Count(const std::vector<bool> &results) {
+    return static_cast<size_t>(
+        std::count(results.begin(), results.end(), true));
+  }
+
+  // Returns true if connection |p| is open, opening it if needed
+  bool Connect(Connections &connections, size_t p) const {
+    if (connections[p] == nullptr || !connections[p]->Ok()) {
+      connections[p] = std::make_unique<partition::Connection>(paths_[p]);
+    }
+    return connections[p]->Ok();
+  }
+
+  bool Single(partition::Operation operation, T elem) {
+    Connections &connections = ThreadConnectionsOf();
+    size_t p = PartitionOf(elem);
+    partition::Request request{static_cast<uint64_t>(elem), operation, {}};
+    uint64_t result = 0;
+    if (!Connect(connections, p) || !connections[p]->Send(&request, 1) ||
+        !connections[p]->Receive(&result, 1)) {
+      errors_++;
+      return false;
+    }
+    return result != 0;
+  }
+
+  // Applies |operation| to |elems| through pipelined batches, and returns
+  // the result of each
+  std::vector<bool> Run(partition::Operation operation,
+                        const std::vector<T> &elems) {
+    Connections &connections = ThreadConnectionsOf();
+    size_t partitions = paths_.size();
+
+    // The requests of each partition, and the index of each in |elems|
+    std::vector<std::vector<partition::Request>> requests(partitions);
+    std::vector<std::vector<size_t>> indices(partitions);
+    for (size_t i = 0; i < elems.size(); i++) {
+      size_t p = PartitionOf(elems[i]);
+      requests[p].push_back(
+          partition::Request{static_cast<uint64_t>(elems[i]), operation, {}});
+      indices[p].push_back(i);
+    }
+
+    // Requests sent and answered so far, per partition
+    std::vector<size_t> sent(partitions, 0);
+    std::vector<size_t> received(partitions, 0);
+    std::vector<bool> failed(partitions, false);
+    for (size_t p = 0; p < partitions; p++) {
+      failed[p] = !requests[p].empty() && !Connect(connections, p);
+    }
+
+    std::vector<bool> results(elems.size(), false);
+    std::vector<uint64_t> replies(max_batch_);
+    bool pending = true;
+    while (pending) {
+      pending = false;
+      for (size_t p = 0; p < partitions; p++) {
+        if (failed[p]) {
+          continue;
+        }
+        // Fill the pipeline, then read the oldest replies
+        size_t total = requests[p].size();
+        while (sent[p] < total &&
+               sent[p] - received[p] < in_flight_) {
+          size_t count = std::min({max_batch_, total - sent[p],
+                                   in_flight_ - (sent[p] - received[p])});
+          if (!connections[p]->Send(&requests[p][sent[p]],
+                                    static_cast<uint32_t>(count))) {
+            failed[p] = true;
+            break;
+          }
+          sent[p] += count;
+        }
+        if (failed[p] || received[p] == sent[p]) {
+          continue;
+        }
+        size_t count = std::min(max_batch_, sent[p] - received[p]);
+        if (!connections[p]->Receive(replies.data(),
+                                     static_cast<uint32_t>(count))) {
+          failed[p] = true;
+          continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+          results[indices[p][received[p] + i]] = replies[i] != 0;
+        }
+        received[p] += count;
+        pending = pending || received[p] < total;
+      }
+    }
+
+    for (size_t p = 0; p < partitions; p++) {
+      if (failed[p]) {
+        errors_ += requests[p].size() - received[p];
+      }
+    }
+    return results;
+  }
+
+  // Returns the calling thread's connections, creating them on first use
+  Connections &ThreadConnectionsOf() const {
+    return partition::ConnectionPool::Of(id_, connections_);
+  }
+};
+
+#endif // PARTITIONED_HASH_SET_H
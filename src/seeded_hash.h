@@ -0,0 +1,113 @@
+#ifndef SEEDED_HASH_H
+#define SEEDED_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <type_traits>
+
+// SipHash with |kCompressionRounds| rounds per 8-byte word and
+// |kFinalizationRounds| at the end, keyed by (|k0|, |k1|).
+template <int kCompressionRounds, int kFinalizationRounds>
+uint64_t SipHash(uint64_t k0, uint64_t k1, const void *data, size_t length) {
+  auto rotl = [](uint64_t x, int b) { return (x << b) | (x >> (64 - b)); };
+  uint64_t v0 = k0 ^ 0x736F6D6570736575ull;
+  uint64_t v1 = k1 ^ 0x646F72616E646F6Dull;
+  uint64_t v2 = k0 ^ 0x6C7967656E657261ull;
+  uint64_t v3 = k1 ^ 0x7465646279746573ull;
+  auto round = [&] {
+    v0 += v1;
+    v1 = rotl(v1, 13);
+    v1 ^= v0;
+    v0 = rotl(v0, 32);
+    v2 += v3;
+    v3 = rotl(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotl(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotl(v1, 17);
+    v1 ^= v2;
+    v2 = rotl(v2, 32);
+  };
+  auto compress = [&](uint64_t word) {
+    v3 ^= word;
+    for (int i = 0; i < kCompressionRounds; i++) {
+      round();
+    }
+    v0 ^= word;
+  };
+
+  // Words are read little-endian, which is the byte order of our hosts
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  size_t full_words = length / 8;
+  for (size_t i = 0; i < full_words; i++) {
+    uint64_t word;
+    std::memcpy(&word, bytes + 8 * i, 8);
+    compress(word);
+  }
+  uint64_t last = static_cast<uint64_t>(length) << 56;
+  for (size_t i = 0; i < length % 8; i++) {
+    last |= static_cast<uint64_t>(bytes[8 * full_words + i]) << (8 * i);
+  }
+  compress(last);
+
+  v2 ^= 0xFF;
+  for (int i = 0; i < kFinalizationRounds; i++) {
+    round();
+  }
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// SipHash-1-3, the variant used by the Rust and Python hash tables
+inline uint64_t SipHash13(uint64_t k0, uint64_t k1, const void *data,
+                          size_t length) {
+  return SipHash<1, 3>(k0, k1, data, length);
+}
+
+// A hash function keyed by a random seed drawn for each instance, so that
+// a set's bucket of a key cannot be predicted from outside the process.
+//
+// std::hash is the identity for integers, so whoever chooses the keys of
+// a set using it can put them all in one bucket. Using SeededHash as the
+// Hash of a set makes that infeasible, at the cost of hashing slower.
+//
+// Strings and types whose bytes are their value are hashed with
+// SipHash-1-3 over their bytes. Other types are hashed through std::hash
+// first, which randomizes their buckets but keeps the collisions of
+// std::hash itself.
+template <typename T> class SeededHash {
+private:
+  uint64_t k0_; // The first half of the SipHash key
+  uint64_t k1_; // The second half of the SipHash key
+
+public:
+  // Draw a new seed
+  SeededHash() {
+    std::random_device random;
+    std::uniform_int_distribution<uint64_t> distribution;
+    k0_ = distribution(random);
+    k1_ = distribution(random);
+  }
+
+  // Use a fixed seed, for reproducible tests
+  SeededHash(uint64_t k0, uint64_t k1) : k0_(k0), k1_(k1) {}
+
+  size_t operator()(const T &elem) const {
+    if constexpr (std::is_same_v<T, std::string>) {
+      return static_cast<size_t>(
+          SipHash13(k0_, k1_, elem.data(), elem.size()));
+    } else if constexpr (std::has_unique_object_representations_v<T>) {
+      return static_cast<size_t>(SipHash13(k0_, k1_, &elem, sizeof(T)));
+    } else {
+      size_t hash = std::hash<T>()(elem);
+      return static_cast<size_t>(SipHash13(k0_, k1_, &hash, sizeof(hash)));
+    }
+  }
+};
+
+#endif // SEEDED_HASH_H
@@ -0,0 +1,481 @@
+#include "src/snapshot.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+namespace snapshot {
+
+namespace {
+
+// Rounds |bytes| up to a whole number of blocks
+size_t RoundUpToBlock(size_t bytes) {
+  return (bytes + kBlockSize - 1) / kBlockSize * kBlockSize;
+}
+
+// Returns |bytes| of kBlockSize aligned memory, or null
+char *AllocateAligned(size_t bytes) {
+  void *data = nullptr;
+  if (posix_memalign(&data, kBlockSize, bytes) != 0) {
+    return nullptr;
+  }
+  return static_cast<char *>(data);
+}
+
+// Returns whether the ring |ring_fd| supports IORING_OP_WRITE. Kernels
+// before 5.6 fail every such write with -EINVAL, and as they cannot probe
+// either, they are found by IORING_REGISTER_PROBE failing.
+bool SupportsWrite(int ring_fd) {
+  constexpr unsigned kOps = 256;
+  std::unique_ptr<io_uring_probe, decltype(&std::free)> probe(
+      static_cast<io_uring_probe *>(std::calloc(
+          1, sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op))),
+      std::free);
+  if (probe == nullptr ||
+      syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE,
+              probe.get(), kOps) < 0) {
+    return false;
+  }
+  return probe->last_op >= IORING_OP_WRITE &&
+         (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+} // namespace
+
+// A minimal io_uring, set up with the raw system calls so that liburing
+// is not needed. It only queues writes, and waits for their completions.
+class Ring {
+private:
+  int fd_ = -1;                        // The ring, or -1 if setup failed
+  void *sq_ring_ = MAP_FAILED;         // The submission queue ring
+  size_t sq_ring_size_ = 0;            // Bytes mapped at sq_ring_
+  void *cq_ring_ = MAP_FAILED;         // The completion queue ring
+  size_t cq_ring_size_ = 0;            // Bytes mapped at cq_ring_
+  void *sqes_ = MAP_FAILED;            // The submission queue entries
+  size_t sqes_size_ = 0;               // Bytes mapped at sqes_
+  unsigned *sq_tail_ = nullptr;        // Written by us
+  unsigned sq_mask_ = 0;               // Entries - 1
+  unsigned *sq_array_ = nullptr;       // Indices into sqes_
+  unsigned *cq_head_ = nullptr;        // Written by us
+  const unsigned *cq_tail_ = nullptr;  // Written by the kernel
+  unsigned cq_mask_ = 0;               // Entries - 1
+  const io_uring_cqe *cqes_ = nullptr; // The completion queue entries
+
+public:
+  // Sets up a ring for |entries| writes in flight, if the kernel
+  // supports writes on it
+  explicit Ring(unsigned entries) {
+    io_uring_params params{};
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      return;
+    }
+    if (!SupportsWrite(fd_)) {
+      Close();
+      return;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_,
+                 static_cast<off_t>(IORING_OFF_SQES));
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+        sqes_ == MAP_FAILED) {
+      Close();
+      return;
+    }
+    auto *sq = static_cast<char *>(sq_ring_);
+    auto *cq = static_cast<char *>(cq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<const unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<const io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  ~Ring() { Close(); }
+
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  // Returns false if the kernel refused to set up the ring, or cannot
+  // write with it
+  [[nodiscard]] bool Ok() const { return fd_ >= 0; }
+
+  // Queues a write of |bytes| at |offset| of |fd|, tagged with |tag|. The
+  // caller keeps fewer writes in flight than the ring has entries.
+  bool Write(int fd, const char *data, size_t bytes, uint64_t offset,
+             uint64_t tag) {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe &sqe = static_cast<io_uring_sqe *>(sqes_)[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITE;
+    sqe.fd = fd;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<uint64_t>(data);
+    sqe.len = static_cast<uint32_t>(bytes);
+    sqe.user_data = tag;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0) < 0) {
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Waits for a write to complete, and returns its tag and result, which
+  // is the number of bytes written or a negated errno
+  bool Wait(uint64_t &tag, int &result) {
+    unsigned head = *cq_head_;
+    while (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                  nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return false;
+      }
+    }
+    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+    tag = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+private:
+  void Close() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    sqes_ = sq_ring_ = cq_ring_ = MAP_FAILED;
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+};
+
+Writer::Writer(const std::string &path, uint32_t element_size,
+               const Options &options)
+    : path_(path), temp_path_(path + ".tmp"), sync_(options.sync),
+      element_size_(element_size),
+      buffer_size_(RoundUpToBlock(
+          std::max(options.buffer_size, sizeof(ChunkHeader) + element_size))) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  if (options.direct) {
+    fd_ = open(temp_path_.c_str(), flags | O_DIRECT, 0644);
+    direct_ = fd_ >= 0;
+  }
+  if (fd_ < 0) {
+    fd_ = open(temp_path_.c_str(), flags, 0644);
+  }
+  if (fd_ < 0) {
+    return;
+  }
+
+  size_t queue_depth = std::max<size_t>(options.queue_depth, 1);
+  buffers_.resize(queue_depth);
+  for (Buffer &buffer : buffers_) {
+    buffer.data = {AllocateAligned(buffer_size_), std::free};
+    if (buffer.data == nullptr) {
+      return;
+    }
+  }
+  if (options.io_uring) {
+    ring_ = std::make_unique<Ring>(static_cast<unsigned>(queue_depth));
+    if (!ring_->Ok()) {
+      ring_.reset();
+    }
+  }
+  ok_ = true;
+}
+
+Writer::~Writer() { Abandon(); }
+
+void Writer::Append(const void *elements, size_t count) {
+  const auto *next = static_cast<const char *>(elements);
+  while (count > 0 && ok_) {
+    if (current_ == kNone) {
+      current_ = Acquire();
+      if (!ok_) {
+        return;
+      }
+      buffers_[current_].used = sizeof(ChunkHeader);
+      buffers_[current_].elements = 0;
+    }
+    Buffer &buffer = buffers_[current_];
+    size_t fit = std::min(count, (buffer_size_ - buffer.used) / element_size_);
+    std::memcpy(buffer.data.get() + buffer.used, next, fit * element_size_);
+    buffer.used += fit * element_size_;
+    buffer.elements += fit;
+    elements_ += fit;
+    next += fit * element_size_;
+    count -= fit;
+    if (buffer_size_ - buffer.used < element_size_) {
+      SubmitChunk(current_);
+      current_ = kNone;
+    }
+  }
+}
+
+bool Writer::Finish() {
+  if (ok_ && current_ != kNone) {
+    SubmitChunk(current_);
+    current_ = kNone;
+  }
+  while (in_flight_ > 0) {
+    WaitOne();
+  }
+  // The chunks must be on disk before a header can point at them
+  if (ok_ && sync_ && fdatasync(fd_) != 0) {
+    ok_ = false;
+  }
+  if (!ok_) {
+    Abandon();
+    return false;
+  }
+
+  size_t header_buffer = Acquire();
+  char *data = buffers_[header_buffer].data.get();
+  std::memset(data, 0, kBlockSize);
+  FileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.element_size = element_size_;
+  header.chunks = chunks_;
+  header.elements = elements_;
+  std::memcpy(data, &header, sizeof(header));
+  Issue(header_buffer, 0, kBlockSize);
+  while (in_flight_ > 0) {
+    WaitOne();
+  }
+  if (ok_ && sync_ && fdatasync(fd_) != 0) {
+    ok_ = false;
+  }
+  if (close(fd_) != 0) {
+    ok_ = false;
+  }
+  fd_ = -1;
+  if (!ok_) {
+    Abandon();
+    return false;
+  }
+
+  // Replace the previous snapshot, and make the rename itself durable
+  if (rename(temp_path_.c_str(), path_.c_str()) != 0) {
+    ok_ = false;
+    Abandon();
+    return false;
+  }
+  finished_ = true;
+  if (sync_) {
+    std::string directory = ".";
+    size_t slash = path_.rfind('/');
+    if (slash != std::string::npos) {
+      directory = slash == 0 ? "/" : path_.substr(0, slash);
+    }
+    int directory_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directory_fd < 0 || fsync(directory_fd) != 0) {
+      ok_ = false;
+    }
+    if (directory_fd >= 0) {
+      close(directory_fd);
+    }
+  }
+  return ok_;
+}
+
+void Writer::Abandon() {
+  // Writes still in flight read from the buffers and write to the file
+  while (in_flight_ > 0 && ring_ != nullptr) {
+    WaitOne();
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  if (!finished_) {
+    unlink(temp_path_.c_str());
+    finished_ = true;
+  }
+}
+
+size_t Writer::Acquire() {
+  while (true) {
+    for (size_t i = 0; i < buffers_.size(); i++) {
+      if (!buffers_[i].in_flight) {
+        return i;
+      }
+    }
+    WaitOne();
+  }
+}
+
+void Writer::SubmitChunk(size_t buffer) {
+  Buffer &chunk = buffers_[buffer];
+  size_t length = RoundUpToBlock(chunk.used);
+  ChunkHeader header{chunk.elements, length};
+  std::memcpy(chunk.data.get(), &header, sizeof(header));
+  std::memset(chunk.data.get() + chunk.used, 0, length - chunk.used);
+  uint64_t offset = next_offset_;
+  next_offset_ += length;
+  chunks_++;
+  Issue(buffer, offset, length);
+}
+
+void Writer::Issue(size_t buffer, uint64_t offset, size_t length) {
+  Buffer &chunk = buffers_[buffer];
+  chunk.offset = offset;
+  chunk.length = length;
+  chunk.written = 0;
+  chunk.in_flight = true;
+  in_flight_++;
+  Resume(buffer);
+}
+
+void Writer::Resume(size_t buffer) {
+  Buffer &chunk = buffers_[buffer];
+  const char *data = chunk.data.get() + chunk.written;
+  size_t bytes = chunk.length - chunk.written;
+  uint64_t offset = chunk.offset + chunk.written;
+  if (ring_ != nullptr) {
+    if (!ring_->Write(fd_, data, bytes, offset, buffer)) {
+      ok_ = false;
+      chunk.in_flight = false;
+      in_flight_--;
+    }
+    return;
+  }
+  while (bytes > 0) {
+    ssize_t result = pwrite(fd_, data, bytes, static_cast<off_t>(offset));
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      ok_ = false;
+      break;
+    }
+    data += result;
+    offset += static_cast<uint64_t>(result);
+    bytes -= static_cast<size_t>(result);
+  }
+  chunk.in_flight = false;
+  in_flight_--;
+}
+
+void Writer::WaitOne() {
+  if (ring_ == nullptr) {
+    return;
+  }
+  uint64_t tag = 0;
+  int result = 0;
+  if (!ring_->Wait(tag, result)) {
+    // No buffer can be reused until the ring is torn down, which waits
+    // for the writes in flight
+    ok_ = false;
+    ring_.reset();
+    for (Buffer &buffer : buffers_) {
+      buffer.in_flight = false;
+    }
+    in_flight_ = 0;
+    return;
+  }
+  Buffer &chunk = buffers_[tag];
+  if (result == -EINTR || result == -EAGAIN) {
+    Resume(tag);
+    return;
+  }
+  if (result > 0) {
+    chunk.written += static_cast<size_t>(result);
+    if (chunk.written < chunk.length) {
+      Resume(tag);
+      return;
+    }
+  } else {
+    ok_ = false;
+  }
+  chunk.in_flight = false;
+  in_flight_--;
+}
+
+bool ReadSnapshot(const std::string &path, uint32_t element_size,
+                  const std::function<void(const char *, size_t)> &f,
+                  std::string &error) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  std::vector<char> block(kBlockSize);
+  FileHeader header{};
+  bool ok = std::fread(block.data(), kBlockSize, 1, file) == 1;
+  if (ok) {
+    std::memcpy(&header, block.data(), sizeof(header));
+    ok = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0;
+  }
+  if (!ok) {
+    error = path + " is not a finished snapshot";
+  } else if (header.version != kVersion) {
+    error = path + " has unsupported version " +
+            std::to_string(header.version);
+    ok = false;
+  } else if (header.element_size != element_size) {
+    error = path + " holds elements of " +
+            std::to_string(header.element_size) + " bytes";
+    ok = false;
+  }
+
+  std::vector<char> chunk;
+  for (uint64_t c = 0; ok && c < header.chunks; c++) {
+    ChunkHeader chunk_header{};
+    ok = std::fread(&chunk_header, sizeof(chunk_header), 1, file) == 1 &&
+         chunk_header.length >= sizeof(chunk_header) &&
+         chunk_header.elements * element_size <=
+             chunk_header.length - sizeof(chunk_header);
+    if (ok) {
+      chunk.resize(chunk_header.length - sizeof(chunk_header));
+      ok = std::fread(chunk.data(), chunk.size(), 1, file) == 1;
+    }
+    if (!ok) {
+      error = path + " is truncated";
+      break;
+    }
+    f(chunk.data(), chunk_header.elements);
+  }
+  std::fclose(file);
+  return ok;
+}
+
+} // namespace snapshot
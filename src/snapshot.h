@@ -0,0 +1,237 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "src/hash_set_base.h"
+
+// Point-in-time copies of a hash set on disk, written without stopping
+// the set's writers for long.
+//
+// WriteSnapshot copies one stripe of the set at a time, holding only that
+// stripe's lock, and hands the copy to a Writer. The Writer packs it into
+// one of a few buffers and queues full buffers to the kernel with
+// io_uring, so the next stripe is copied while earlier ones are written.
+// Where io_uring is unavailable, for example under a seccomp filter or
+// before Linux 5.6, it falls back to pwrite.
+//
+// Every element of a stripe maps to that stripe for the life of the set,
+// so an element present throughout the snapshot is written exactly once.
+// Elements added or removed meanwhile may or may not be written, as with
+// ForEach.
+//
+// A snapshot file is a block holding the FileHeader, followed by chunks
+// of at most one buffer each: a ChunkHeader, the elements as-is, and zero
+// padding up to a whole block, so that the file can be written with
+// O_DIRECT.
+//
+// The file is written as |path|.tmp and renamed over |path| once done,
+// so the previous snapshot stays intact until the new one replaces it.
+// The chunks are synced before the header is written, and the header
+// before the rename, so a snapshot found at |path| is complete even after
+// a power loss.
+namespace snapshot {
+
+// The alignment of buffers, file offsets and write lengths
+constexpr size_t kBlockSize = 4096;
+
+struct FileHeader {
+  char magic[8];         // kMagic
+  uint32_t version;      // kVersion
+  uint32_t element_size; // sizeof of the set's element type
+  uint64_t chunks;       // The number of chunks after the header block
+  uint64_t elements;     // The number of elements in all chunks
+};
+
+struct ChunkHeader {
+  uint64_t elements; // The number of elements that follow
+  uint64_t length;   // The bytes of the chunk, including header and padding
+};
+
+constexpr char kMagic[8] = {'H', 'S', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t kVersion = 1;
+
+struct Options {
+  size_t buffer_size = size_t{1} << 20; // The bytes of each buffer
+  size_t queue_depth = 8;               // Buffers, and writes in flight
+  bool direct = false;  // Open with O_DIRECT, bypassing the page cache
+  bool sync = true;     // Sync the file and its directory before returning
+  bool io_uring = true; // Use io_uring when the kernel allows it
+};
+
+struct Stats {
+  bool io_uring = false;         // Writes went through io_uring
+  bool direct = false;           // The file was opened with O_DIRECT
+  uint64_t stripes = 0;          // Stripes copied
+  uint64_t elements = 0;         // Elements written
+  uint64_t bytes = 0;            // Size of the file
+  uint64_t max_stripe_nanos = 0; // Longest copy of a stripe, with its lock
+};
+
+class Ring;
+
+// Writes a snapshot file from elements appended in any number of calls
+class Writer {
+private:
+  struct Buffer {
+    // kBlockSize aligned, from posix_memalign
+    std::unique_ptr<char, void (*)(void *)> data{nullptr, nullptr};
+    size_t used = 0;        // Bytes filled, including the ChunkHeader
+    uint64_t elements = 0;  // Elements filled
+    uint64_t offset = 0;    // Where the buffer is being written
+    size_t length = 0;      // Bytes being written, from offset
+    size_t written = 0;     // Bytes of length already written
+    bool in_flight = false; // A write of the buffer is queued
+  };
+
+  static constexpr size_t kNone = static_cast<size_t>(-1);
+
+  std::string path_;                  // Where the snapshot goes
+  std::string temp_path_;             // Where it is written until done
+  int fd_ = -1;                       // The file at temp_path_
+  bool ok_ = false;                   // False after any error
+  bool finished_ = false;             // temp_path_ was renamed or removed
+  bool direct_ = false;               // fd_ was opened with O_DIRECT
+  bool sync_;                         // Options::sync
+  uint32_t element_size_;             // The bytes of one element
+  size_t buffer_size_;                // The bytes of each buffer
+  std::unique_ptr<Ring> ring_;        // Null when writing with pwrite
+  std::vector<Buffer> buffers_;       // Options::queue_depth buffers
+  size_t current_ = kNone;            // The buffer being filled
+  size_t in_flight_ = 0;              // Buffers with a queued write
+  uint64_t next_offset_ = kBlockSize; // Where the next chunk goes
+  uint64_t chunks_ = 0;               // Chunks queued
+  uint64_t elements_ = 0;             // Elements appended
+
+public:
+  // Creates |path|.tmp, truncating it, for elements of |element_size|
+  // bytes. |path| is only replaced by Finish.
+  Writer(const std::string &path, uint32_t element_size,
+         const Options &options);
+  ~Writer();
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  // Returns false if the file could not be opened or written
+  [[nodiscard]] bool Ok() const { return ok_; }
+
+  // Returns true if writes go through io_uring
+  [[nodiscard]] bool UsesIoUring() const { return ring_ != nullptr; }
+
+  // Returns true if the file was opened with O_DIRECT. File systems that
+  // do not support it, such as tmpfs, get a buffered file instead.
+  [[nodiscard]] bool Direct() const { return direct_; }
+
+  // Returns the size of the file once finished
+  [[nodiscard]] uint64_t Bytes() const { return next_offset_; }
+
+  // Appends |count| elements, copying them before returning. May wait
+  // for an earlier buffer to be written if all of them are in flight.
+  void Append(const void *elements, size_t count);
+
+  // Writes what is left, syncs it, writes the header and syncs again,
+  // then renames the file over |path| and syncs its directory. Syncing is
+  // skipped unless Options::sync is set. Returns false on any error, and
+  // then leaves |path| as it was.
+  bool Finish();
+
+private:
+  // Returns a buffer that is not in flight, waiting for one if needed
+  size_t Acquire();
+
+  // Queues the filled |buffer| as the next chunk
+  void SubmitChunk(size_t buffer);
+
+  // Writes |length| bytes of |buffer| at |offset|
+  void Issue(size_t buffer, uint64_t offset, size_t length);
+
+  // Queues the unwritten rest of |buffer|, or writes it with pwrite
+  void Resume(size_t buffer);
+
+  // Waits for one write to complete
+  void WaitOne();
+
+  // Waits for the writes in flight, closes the file, and removes it
+  // unless it was renamed
+  void Abandon();
+};
+
+// Calls |f| on the elements of every chunk of the snapshot at |path|.
+// Returns false, with a message in |error|, if the file is missing, not a
+// finished snapshot, or holds elements of another size.
+bool ReadSnapshot(const std::string &path, uint32_t element_size,
+                  const std::function<void(const char *, size_t)> &f,
+                  std::string &error);
+
+// Writes a snapshot of |hash_set| to |path|. HashSet must provide
+// Stripes() and CopyStripe(stripe, out), as HashSetStriped and
+// HashSetRefinable do. Returns false on any error.
+template <typename HashSet>
+bool WriteSnapshot(HashSet &hash_set, const std::string &path,
+                   const Options &options = Options(),
+                   Stats *stats = nullptr) {
+  using T = typename HashSetElement<HashSet>::Type;
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Snapshots hold elements as-is");
+  using Clock = std::chrono::steady_clock;
+
+  Writer writer(path, sizeof(T), options);
+  std::vector<T> stripe;
+  uint64_t elements = 0;
+  uint64_t max_stripe_nanos = 0;
+  size_t stripes = hash_set.Stripes();
+  for (size_t s = 0; s < stripes && writer.Ok(); s++) {
+    stripe.clear();
+    auto start = Clock::now();
+    hash_set.CopyStripe(s, stripe);
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start);
+    max_stripe_nanos =
+        std::max(max_stripe_nanos, static_cast<uint64_t>(nanos.count()));
+    writer.Append(stripe.data(), stripe.size());
+    elements += stripe.size();
+  }
+  bool ok = writer.Finish();
+  if (stats != nullptr) {
+    stats->io_uring = writer.UsesIoUring();
+    stats->direct = writer.Direct();
+    stats->stripes = stripes;
+    stats->elements = elements;
+    stats->bytes = writer.Bytes();
+    stats->max_stripe_nanos = max_stripe_nanos;
+  }
+  return ok;
+}
+
+// Adds the elements of the snapshot at |path| to |hash_set|. Returns
+// false, with a message in |error|, as ReadSnapshot does.
+template <typename T>
+bool LoadSnapshot(const std::string &path, HashSetBase<T> &hash_set,
+                  std::string &error) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Snapshots hold elements as-is");
+  return ReadSnapshot(
+      path, sizeof(T),
+      [&hash_set](const char *elements, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+          T elem;
+          std::memcpy(&elem, elements + i * sizeof(T), sizeof(T));
+          hash_set.Add(elem);
+        }
+      },
+      error);
+}
+
+} // namespace snapshot
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,73 @@
+#include "src/trace.h"
+
+#include <cstring>
+
+namespace trace {
+
+Writer::Writer(const std::string &path)
+    : file_(std::fopen(path.c_str(), "wb")) {
+  if (file_ == nullptr) {
+    return;
+  }
+  FileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.record_size = sizeof(Record);
+  if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+Writer::~Writer() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+  }
+}
+
+bool Writer::Write(const Record *records, size_t count) {
+  if (file_ == nullptr) {
+    return false;
+  }
+  return std::fwrite(records, sizeof(Record), count, file_) == count;
+}
+
+void Writer::Flush() {
+  if (file_ != nullptr) {
+    std::fflush(file_);
+  }
+}
+
+bool ReadTrace(const std::string &path, std::vector<Record> &records,
+               std::string &error) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  FileHeader header{};
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0;
+  if (!ok) {
+    error = path + " is not a trace file";
+  } else if (header.version != kVersion ||
+             header.record_size != sizeof(Record)) {
+    error = path + " has unsupported version " +
+            std::to_string(header.version);
+    ok = false;
+  }
+
+  Record record{};
+  while (ok && std::fread(&record, sizeof(record), 1, file) == 1) {
+    records.push_back(record);
+  }
+  if (ok && std::ferror(file) != 0) {
+    error = "error reading " + path;
+    ok = false;
+  }
+  std::fclose(file);
+  return ok;
+}
+
+} // namespace trace
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Binary traces of hash set operations, for replaying captured workloads
+// against other implementations.
+//
+// A trace file is a FileHeader followed by Records, both written in the
+// native (little-endian on all our hosts) byte order. Records of one
+// thread are in the order that thread issued them; records of different
+// threads are interleaved in no particular order, and their timestamps
+// give the global order.
+namespace trace {
+
+enum class Operation : uint8_t { kAdd = 0, kRemove = 1, kContains = 2 };
+
+struct Record {
+  uint64_t timestamp_nanos; // Time of the operation since the trace start
+  uint64_t key;             // The key, or its hash for non-integral keys
+  uint32_t thread_id;       // Dense id, reused once its thread exits
+  Operation operation;      // The HashSetBase method that was called
+  uint8_t result;           // 1 if the method returned true, and 0 otherwise
+  uint16_t reserved;        // Always 0
+};
+static_assert(sizeof(Record) == 24, "Records are written as-is");
+
+struct FileHeader {
+  char magic[8];        // kMagic
+  uint32_t version;     // kVersion
+  uint32_t record_size; // sizeof(Record)
+};
+
+constexpr char kMagic[8] = {'H', 'S', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr uint32_t kVersion = 1;
+
+// Appends records to a trace file
+class Writer {
+private:
+  std::FILE *file_; // The open trace file, or nullptr on error
+
+public:
+  // Creates |path|, truncating it, and writes the header
+  explicit Writer(const std::string &path);
+  ~Writer();
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  // Returns false if the file could not be opened or written
+  [[nodiscard]] bool Ok() const { return file_ != nullptr; }
+
+  // Appends |count| records, and returns false on error
+  bool Write(const Record *records, size_t count);
+
+  // Flushes buffered records to the file
+  void Flush();
+};
+
+// Reads all records of the trace at |path|. Returns false, with a message
+// in |error|, if the file is missing or not a trace.
+bool ReadTrace(const std::string &path, std::vector<Record> &records,
+               std::string &error);
+
+} // namespace trace
+
+#endif // TRACE_H